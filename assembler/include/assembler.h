@@ -45,8 +45,6 @@ public:
 
     std::unordered_map<Symbol *, EquOperand *> equExpr;
     std::unordered_map<Symbol *, std::list<Instruction *>> equBackPatch;
-    // tryToResolve for .word
-    std::unordered_map<Symbol *, std::list<void *>> wordBackPatch;
 
     int32_t currSection = 0;
 
@@ -97,6 +95,10 @@ public:
 
     void parseXchg(unsigned char, unsigned char);       // done
 
+    void parseSwap(unsigned char, unsigned char);
+
+    void parseCas(unsigned char, unsigned char, unsigned char);
+
     void parseTwoReg(unsigned char, unsigned char, unsigned char);  // done
 
     void parseCsrrd(unsigned char, unsigned char);      // done
@@ -117,8 +119,6 @@ public:
 
     void resolveEqu();
 
-    void resolveWord();
-
     void checkUnresolvedSymbols();
 
     void logSections(std::ostream &) const;
@@ -141,13 +141,11 @@ public:
 
     int32_t getSymbolIndex(const std::string &) const;
 
-    Relocation *addRelLiteral(IndexSymbol, int = 0);
+    Relocation *addRelPool(uint32_t, const std::string &);
 
-    Relocation *addRelSymbol(IndexSymbol, int = 0);
+    Relocation *addRelSymbol(IndexSymbol);
 
-    Relocation *symbolAlreadyRelocated(IndexSymbol) const;
-
-    Relocation *addRelLiteral(uint32_t, int = 0);
+    Relocation *addRelLiteral(uint32_t);
 
     void insertInstr(Instruction *instr);
 
@@ -175,8 +173,6 @@ public:
 
     [[nodiscard]]  bool isSymbolGlobal(const std::string &) const;
 
-    RELOCATION getRelocationType(Symbol *, bool = false) const;
-
     uint32_t getValueOfSymbol(Symbol *) const;
 
 };
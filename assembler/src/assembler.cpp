@@ -88,7 +88,7 @@ void Assembler::parseSkip(int literal) {
 #ifdef LOG_PARSER
     std::cout << "SKIP: " << literal << "\n";
 #endif
-    sections[currSection]->core.addToLocCounter(literal);
+    sections[currSection]->core.skip(literal);
 }
 
 void Assembler::resolveEqu() {
@@ -138,37 +138,15 @@ void Assembler::resolveEqu() {
         delete par.second;
 }
 
-void Assembler::resolveWord() {
-    for (auto &par: wordBackPatch) {
-        auto symbol = par.first;
-        if (!symbol->core.flags.defined)
-            symbolNotDefined(symbol->core.name);
-        auto list = par.second;
-        for (auto &dest: list) {
-            void *src;
-            if (symbol->core.flags.symbolType == EQU) {
-                // copy value of the symbol, value is symbol offset
-                src = (char *) &symbol->core.offset;
-            } else {
-                auto section = sections[symbol->core.sectionIndex].get();
-                auto base = section->core.data.data();
-                src = base + symbol->core.offset;
-            }
-            std::memcpy(dest, src, 4);
-        }
-    }
-}
-
 void Assembler::parseEnd() {
 #ifdef LOG_PARSER
     std::cout << "END" << "\n";
 #endif
     resolveEqu();
-    resolveWord();
     writeTxt();
     checkUnresolvedSymbols();
     correctRelocations();
-//    deleteRelocations();
+    deleteRelocations();
     appendLiterals();
     writeTxt();
     writeObj();
@@ -378,6 +356,22 @@ void Assembler::parseXchg(unsigned char regS, unsigned char regD) {
     instr->insertInstr(this);
 }
 
+void Assembler::parseSwap(unsigned char addr, unsigned char gpr) {
+#ifdef LOG_PARSER
+    std::cout << "SWAP: [%r" << (short) addr << "], %r" << (short) gpr << "\n";
+#endif
+    auto instr = std::make_unique<Swap_Instr>(addr, gpr);
+    instr->insertInstr(this);
+}
+
+void Assembler::parseCas(unsigned char addr, unsigned char expected, unsigned char gpr) {
+#ifdef LOG_PARSER
+    std::cout << "CAS: [%r" << (short) addr << "], %r" << (short) expected << ", %r" << (short) gpr << "\n";
+#endif
+    auto instr = std::make_unique<Cas_Instr>(addr, expected, gpr);
+    instr->insertInstr(this);
+}
+
 void Assembler::parseTwoReg(unsigned char inst, unsigned char regS, unsigned char regD) {
 #ifdef LOG_PARSER
     std::cout << static_cast<enum INSTRUCTION>(inst) << ": ";
@@ -489,6 +483,10 @@ void Assembler::writeObj() {
     if (!out.is_open())
         throw std::runtime_error("Error: Unable to open file " + output);
 
+    // writeAndIncr magic, version
+    out.write((char *) &OBJECT_MAGIC, sizeof(OBJECT_MAGIC));
+    out.write((char *) &OBJECT_VERSION, sizeof(OBJECT_VERSION));
+
     // writeAndIncr num_symbols
     uint32_t num_symbols = symbols.size();
     out.write((char *) &num_symbols, sizeof(uint32_t));
@@ -509,14 +507,19 @@ void Assembler::writeObj() {
     uint32_t num_sections = sections.size();
     out.write((char *) &num_sections, sizeof(uint32_t));
 
-    // writeAndIncr Sections: name_size, name, data_size
+    // writeAndIncr Sections: name_size, name, data_size, data, zero_fill, num_code, code ranges
     for (auto &sect: sections) {
         uint32_t name_size = sect->core.name.size();
         out.write((char *) &name_size, sizeof(name_size));
         out.write(sect->core.name.c_str(), name_size);
-        auto data_size = sect->coreSize();
+        uint32_t data_size = sect->core.data.size();
         out.write((char *) &data_size, sizeof(data_size));
         out.write(reinterpret_cast<const char *>(sect->core.data.data()), data_size);
+        out.write((char *) &sect->core.zeroFill, sizeof(sect->core.zeroFill));
+        uint32_t num_code = sect->core.code.size();
+        out.write((char *) &num_code, sizeof(num_code));
+        out.write(reinterpret_cast<const char *>(sect->core.code.data()),
+                  num_code * sizeof(sect->core.code[0]));
     }
 
     // writeAndIncr Relocations: symbol_index, section_index, offset, type
@@ -568,69 +571,60 @@ IndexSymbol Assembler::declareSymbol(const std::string &ident) {
     return {(uint32_t) symbols.size() - 1, symbols.back().get()};
 }
 
-Relocation *Assembler::addRelLiteral(IndexSymbol symbol, int offset) {
+Relocation *Assembler::addRelPool(uint32_t poolOffset, const std::string &name) {
+    // displacement of the instruction being parsed, symbolIndex holds the offset of its word in the pool
     relocations.emplace_back(std::make_unique<Relocation>(
-            "PC+" + symbol.symbol->core.name,
-            getSymbolIndex(symbol.symbol->core.name),
+            "PC+" + name,
+            poolOffset,
             currSection,
-            sections[currSection]->core.locationCnt() + DISPLACEMENT_SIZE_BYTES + offset,
+            sections[currSection]->core.locationCnt() + DISPLACEMENT_SIZE_BYTES,
             R_12b
     ));
     return relocations.back().get();
 }
 
-Relocation *Assembler::addRelSymbol(IndexSymbol symbol, int offsetLiteral) {
-    addRelLiteral(symbol, offsetLiteral);
-    auto rel = symbolAlreadyRelocated(symbol);
-    if (rel)
-        return rel;
-    auto offset = sections[currSection]->addLabel(symbol.symbol->core.name);
-    auto relType = getRelocationType(symbol.symbol);
-    relocations.emplace_back(std::make_unique<Relocation>(
-            symbol.symbol->core.name,
-            getSymbolIndex(symbol.symbol->core.name),
-            currSection,
-            offset,
-            relType
-    ));
-    return relocations.back().get();
+Relocation *Assembler::addRelSymbol(IndexSymbol symbol) {
+    // one pool word per label, the linker writes its address there
+    auto &section = *sections[currSection].get();
+    auto &name = symbol.symbol->core.name;
+    auto pooled = section.labelsMap.find(name) != section.labelsMap.end();
+    auto offset = section.addLabel(name);
+    if (!pooled)
+        relocations.emplace_back(std::make_unique<Relocation>(
+                name,
+                symbol.index,
+                currSection,
+                offset,
+                R_32_IMMEDIATE
+        ));
+    return addRelPool(offset, name);
 }
 
-Relocation *Assembler::addRelLiteral(uint32_t value, int offsetLiteral) {
-    auto &section = *sections[currSection].get();
-    auto offset = section.addLiteral(value);
-    relocations.emplace_back(std::make_unique<Relocation>(
-            "PC+" + std::to_string(value),
-            offset / 4,
-            currSection,
-            section.core.locationCnt() + DISPLACEMENT_SIZE_BYTES + offsetLiteral,
-            R_12b
-    ));
-    return relocations.back().get();
+Relocation *Assembler::addRelLiteral(uint32_t value) {
+    auto offset = sections[currSection]->addLiteral(value);
+    return addRelPool(offset, std::to_string(value));
 }
 
 void Assembler::correctRelocations() {
     for (auto &rel: relocations) {
-        if (rel->core.type == R_32_UND) {
-            rel->core.symbolIndex = getSymbolIndex(symbols[rel->core.symbolIndex]->core.name);
-            rel->core.type = R_32b_LOCAL;
-        }
-        if (rel->core.type == R_32b_LOCAL) {
-            auto symbol = symbols[rel->core.symbolIndex].get();
-            auto value = getValueOfSymbol(symbol);
-            auto section = sections[rel->core.sectionIndex].get()->literalsSection;
-            section.fixWord(&value, rel->core.offset);
-        } else if (rel->core.type == R_32_IMMEDIATE)
-            rel->core.offset += (int32_t) sections[rel->core.sectionIndex]->core.locationCnt() + JMP_OVER_LITERALS;
-    }
-    for (auto &rel: relocations) {
+        auto &section = *sections[rel->core.sectionIndex].get();
         if (rel->core.type == R_12b) {
-            auto destPtr =
-                    sections[rel->core.sectionIndex].get()->core.data.data() + rel->core.offset;
-            int32_t symbolOffset = (int32_t) sections[rel->core.sectionIndex]->core.locationCnt()
-                                   - (rel->core.offset - DISPLACEMENT_SIZE_BYTES) + JMP_OVER_LITERALS + 4;
-            writeDisplacement(destPtr, symbolOffset);
+            // the pool follows the code and the jmp over it
+            int32_t displacement = (int32_t) (section.coreSize() + JMP_OVER_LITERALS + rel->core.symbolIndex)
+                                   - (int32_t) (rel->core.offset - DISPLACEMENT_SIZE_BYTES);
+            if (!fitIn12Bits(displacement))
+                displacementToBig(displacement);
+            writeDisplacement(section.core.data.data() + rel->core.offset, displacement);
+            continue;
         }
+        auto symbol = symbols[rel->core.symbolIndex].get();
+        if (symbol->core.flags.symbolType == EQU) {
+            // used before its .equ, the value is known now and needs no linking
+            auto &dest = rel->core.type == R_32_IMMEDIATE ? section.literalsSection : section.core;
+            dest.fixWord(&symbol->core.offset, rel->core.offset);
+            rel->core.type = R_32b_LOCAL;
+        } else if (rel->core.type == R_32_IMMEDIATE)
+            rel->core.offset += (int32_t) section.coreSize() + JMP_OVER_LITERALS;
     }
 }
 
@@ -665,26 +659,6 @@ uint32_t Assembler::getValueOfSymbol(Symbol *symbol) const {
     return section->readWord(symbol->core.offset);
 }
 
-Relocation *Assembler::symbolAlreadyRelocated(IndexSymbol symbol) const {
-//        if ((rel->core.type == R_32b_LOCAL || rel->core.type == R_32_GLOBAL || rel->core.type == R_32_UND)
-    for (auto &rel: relocations)
-        if (rel->core.type != R_12b && rel->core.symbolIndex == symbol.index)
-            return rel.get();
-    return nullptr;
-}
-
-RELOCATION Assembler::getRelocationType(Symbol *symbol, bool fromWord) const {
-    if (symbol->core.flags.source == THIS) {
-        if (symbol->core.sectionIndex == UNDEFINED)
-            return R_32_UND;
-        else if (symbol->core.sectionIndex == currSection)
-            return R_32b_LOCAL;
-    }
-    if (fromWord)
-        return R_32_IN_DIR;
-    return R_32_IMMEDIATE;
-}
-
 void Assembler::parseCondJmp(unsigned char inst, unsigned char regS, unsigned char regD, Operand *operand) {
 #ifdef LOG_PARSER
     auto _inst = static_cast<enum INSTRUCTION>(inst);
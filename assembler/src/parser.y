@@ -59,6 +59,8 @@
 %token              I_PUSH
 %token              I_POP
 %token              I_XCHG
+%token              I_SWAP
+%token              I_CAS
 %token              I_ADD
 %token              I_SUB
 %token              I_MUL
@@ -76,6 +78,7 @@
 %token              STATUS_CSR
 %token              HANDLER_CSR
 %token              CAUSE_CSR
+%token              COREID_CSR
 
 %token <num_u8>     REG
 %token <num_u8>     SP
@@ -202,6 +205,12 @@ instruction
   | I_XCHG T_PERCENT REG T_COMMA T_PERCENT REG
   { Assembler::singleton().parseXchg($3, $6); }
 
+  | I_SWAP T_OBRACKET T_PERCENT gpr T_CBRACKET T_COMMA T_PERCENT gpr
+  { Assembler::singleton().parseSwap($4, $8); }
+
+  | I_CAS T_OBRACKET T_PERCENT gpr T_CBRACKET T_COMMA T_PERCENT gpr T_COMMA T_PERCENT gpr
+  { Assembler::singleton().parseCas($4, $8, $11); }
+
   | tworeg T_PERCENT REG T_COMMA T_PERCENT REG
   { Assembler::singleton().parseTwoReg($1, $3, $6); }
 
@@ -278,7 +287,10 @@ csr
   { $$ = REG_CSR::CSR_HANDLER; }
 
   | CAUSE_CSR
-  { $$ = REG_CSR::CSR_CAUSE; };
+  { $$ = REG_CSR::CSR_CAUSE; }
+
+  | COREID_CSR
+  { $$ = REG_CSR::CSR_COREID; };
 
 gpr
   : REG
@@ -6,6 +6,9 @@
 
 static constexpr auto DISPLACEMENT_MAX_VALUE = 0x7FF;
 static constexpr auto DISPLACEMENT_MIN_VALUE = -0x800;
+static constexpr uint32_t ZERO_FILL_FLAG = 0x80000000;    // executable section record of zeros, no bytes follow
+static constexpr uint32_t OBJECT_MAGIC = 0x004a424f;      // "OBJ", first word of .o and -relocatable output
+static constexpr uint32_t OBJECT_VERSION = 2;             // 2 added the zero fill after the section data
 
 class Symbol;
 
@@ -69,7 +72,8 @@ enum REG_GPR {
 enum REG_CSR {
     CSR_STATUS,
     CSR_HANDLER,
-    CSR_CAUSE
+    CSR_CAUSE,
+    CSR_COREID          // index of the core, read only by convention
 };
 
 enum RELOCATION {
@@ -81,7 +85,7 @@ enum RELOCATION {
 };
 
 enum STATUS {
-    FAULT = 1, TIMER, TERMINAL, SOFTWARE
+    FAULT = 1, TIMER, TERMINAL, SOFTWARE, IPI, DMA, DISK
 };
 
 enum SYMBOL {
@@ -131,6 +135,8 @@ enum INSTRUCTION {
     BGT_MEM = 0b00111011,           // if (gpr[B] signed> gpr[C]) pc<=memory[gpr[A=PC]+D]
 
     XCHG = 0b01000000,              // temp<=gpr[B]; gpr[B]<=gpr[C]; gpr[C]<=temp;
+    SWAP = 0b01000001,              // atomic: temp<=memory[gpr[A]]; memory[gpr[A]]<=gpr[C]; gpr[C]<=temp;
+    CAS = 0b01000010,               // atomic: temp<=memory[gpr[A]]; if (temp == gpr[B]) memory[gpr[A]]<=gpr[C]; gpr[C]<=temp;
 
     ADD = 0b01010000,               // gpr[A]<=gpr[B]+gpr[C]
     SUB = 0b01010001,               // gpr[A]<=gpr[B]-gpr[C]
@@ -157,6 +163,8 @@ enum INSTRUCTION {
     CSR_LD_OR = 0b10010101,         // csr[A]<=csr[B]|D
     CSR_LD_IND = 0b10010110,        // csr[A]<=memory[gpr[B]+gpr[C]+D]
     CSR_LD_POST_INC = 0b10010111,   // csr[A]<=memory[gpr[B]]; gpr[B]<=gpr[B]+D // pop csr
+
+    BREAKPOINT = 0b11111111,        // patched in by the debugger, never assembled
 };
 
 typedef union {
@@ -194,3 +202,5 @@ std::ostream &operator<<(std::ostream &, SCOPE);
 std::ostream &operator<<(std::ostream &, enum INSTRUCTION);
 
 std::ostream &operator<<(std::ostream &, RELOCATION);
+
+std::ostream &operator<<(std::ostream &, enum STATUS);
@@ -107,6 +107,22 @@ public:
 
 };
 
+class Swap_Instr : public Instruction {
+public:
+    explicit Swap_Instr(uint8_t, uint8_t);
+
+    explicit Swap_Instr(uint32_t bytes) : Instruction(bytes) {}
+
+};
+
+class Cas_Instr : public Instruction {
+public:
+    explicit Cas_Instr(uint8_t, uint8_t, uint8_t);
+
+    explicit Cas_Instr(uint32_t bytes) : Instruction(bytes) {}
+
+};
+
 class Csrrd_Instr : public Instruction {
 public:
     explicit Csrrd_Instr(uint8_t, uint8_t);
@@ -138,7 +154,7 @@ public:
 
     explicit Store_Instr(uint32_t bytes) : Instruction(bytes) {}
 
-    explicit Store_Instr(uint8_t, int16_t, uint8_t);
+    explicit Store_Instr(uint8_t, uint8_t, int16_t);
 };
 
 class TwoReg_Instr : public Instruction {
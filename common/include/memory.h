@@ -1,21 +1,80 @@
 #pragma once
 
 #include <cstdint>
+#include <cstring>
 #include <vector>
 #include <unordered_map>
 #include <memory>
+#include <istream>
+#include <ostream>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
+
+enum RAM_BACKING {
+    RAM_SEGMENTS,           // one heap allocation per segment
+    RAM_REGIONS,            // segments carved from HUGE_REGION_SIZE regions, huge pages were refused
+    RAM_TRANSPARENT_HUGE,   // regions advised with MADV_HUGEPAGE
+    RAM_HUGETLB             // regions mapped with MAP_HUGETLB from the reserved pool
+};
+
+static constexpr uint32_t HUGE_REGION_SIZE = 2 * 1024 * 1024;
+
+enum SEGMENT_FLAG {
+    SEG_DIRTY = 1,          // written since the last takeDirty()
+    SEG_WATCHED = 2,        // writes are reported to watchHandler
+    SEG_CODE = 4            // holds decoded instructions, writes are reported to codeWriteHandler
+};
+
+// Bytes of one segment, owned or borrowed from a mapped image. Reads and writes like the vector it replaces.
+class SegmentBytes {
+    std::vector<uint8_t> owned;
+    uint8_t *bytes;
+    size_t length;
+public:
+    explicit SegmentBytes(size_t size) : owned(size), bytes(owned.data()), length(size) {}
+
+    SegmentBytes(uint8_t *mapped, size_t size) : bytes(mapped), length(size) {}
+
+    SegmentBytes(const SegmentBytes &) = delete;
+
+    SegmentBytes &operator=(const std::vector<uint8_t> &);
+
+    operator std::vector<uint8_t>() const { return {bytes, bytes + length}; }
+
+    [[nodiscard]] uint8_t *data() const { return bytes; }
+
+    [[nodiscard]] uint8_t *begin() const { return bytes; }
+
+    [[nodiscard]] uint8_t *end() const { return bytes + length; }
+
+    [[nodiscard]] size_t size() const { return length; }
+
+    [[nodiscard]] bool mapped() const { return owned.empty(); }
+};
 
 class Segment {
 public:
     explicit Segment(uint32_t);
 
+    Segment(uint8_t *, uint32_t);
+
     ~Segment() = default;
 
-    [[nodiscard]] int32_t readWord(uint32_t) const;
+    // unchecked, the word has to lie inside the segment
+    [[nodiscard]] int32_t readWord(uint32_t offset) const {
+        uint32_t ret;
+        std::memcpy(&ret, data.data() + offset, sizeof(ret));
+        return (int32_t) ret;
+    }
 
-    void writeWord(uint32_t, uint32_t) const;
+    void writeWord(uint32_t offset, uint32_t value) const {
+        std::memcpy(data.data() + offset, &value, sizeof(value));
+    }
 
-    std::vector<uint8_t> data;
+    SegmentBytes data;
+    std::atomic<uint8_t> flags{0};      // read without a lock by every core
 
 };
 
@@ -26,6 +85,16 @@ public:
     uint64_t _size;
     uint32_t _segmentSize;
     std::unordered_map<uint32_t, std::unique_ptr<Segment>> _segments;
+    std::vector<uint32_t> _dirtySegments;
+    std::vector<std::shared_ptr<void>> _mappings;     // images whose pages back segments
+    std::unordered_map<uint32_t, std::shared_ptr<void>> _regions;     // by address / HUGE_REGION_SIZE
+    RAM_BACKING backing = RAM_SEGMENTS;
+    std::vector<bool> _written;     // by segment index, every segment dirtied since trackWrites()
+    std::function<void(uint32_t)> watchHandler;
+    std::function<void(uint32_t)> codeWriteHandler;
+    bool concurrent = false;        // shared by several cores, the segment table and dirty list are locked
+    uint64_t generation = 0;        // changes when segments are dropped, Segment pointers kept elsewhere are stale
+    std::shared_mutex segmentsMutex;
 
     explicit Memory(uint64_t, uint64_t, uint32_t);
 
@@ -33,12 +102,67 @@ public:
 
     void writeWord(uint32_t, uint32_t);
 
+    // atomic on aligned words, even against other cores, both return the old value
+    int32_t exchange(uint32_t, uint32_t);
+
+    int32_t compareExchange(uint32_t, uint32_t, uint32_t);
+
     [[nodiscard]] bool isAddrValid(uint32_t) const;
 
+    [[nodiscard]] bool isRangeValid(uint32_t, uint32_t) const;
+
     Segment &getSegment(uint32_t);
 
+    std::unique_ptr<Segment> allocate(uint32_t);
+
+    uint8_t *region(uint32_t);
+
+    // new segments come from 2 MiB regions backed by huge pages where the host has them
+    void useHugePages();
+
+    [[nodiscard]] const char *backingName() const;
+
+    void report(std::ostream &) const;
+
     void loadMemory(uint32_t, std::vector<uint8_t> &);
 
+    void mapMemory(uint32_t, uint8_t *, uint32_t, const std::shared_ptr<void> &);
+
+    // clears the range in segments that already exist, the others read as zero anyway
+    void zeroMemory(uint32_t, uint32_t);
+
+    // bulk transfers for devices, segment by segment; copies may overlap in either direction
+    void readBytes(uint32_t, uint8_t *, uint32_t);
+
+    void writeBytes(uint32_t, const uint8_t *, uint32_t);
+
+    void copyMemory(uint32_t, uint32_t, uint32_t);
+
+    void fillMemory(uint32_t, uint8_t, uint32_t);
+
+    void checkRange(uint32_t, uint32_t) const;
+
+    void markDirty(uint32_t, Segment &);
+
+    void touch(uint32_t, Segment &, uint32_t);
+
+    void patchWord(uint32_t, uint32_t);
+
+    void setFlags(uint32_t, uint32_t, uint8_t);
+
+    void clearFlags(uint8_t);
+
+    std::vector<uint32_t> takeDirty();
+
+    // starts a fresh dirty period, what was loaded before does not count as written
+    void trackWrites();
+
+    [[nodiscard]] std::vector<uint32_t> writtenSegments() const;
+
+    void save(std::ostream &) const;
+
+    void restore(std::istream &);
+
     [[nodiscard]] uint32_t getSegmentIndex(uint32_t) const;
 
 };
\ No newline at end of file
@@ -8,26 +8,61 @@
 #include <chrono>
 #include <fstream>
 #include <set>
+#include <atomic>
+#include <istream>
+
+class Observer;
+
+class EventLog;
+
+struct DeviceEvent;
+
+class BlockDevice;
+
+class Semihost;
+
+struct LoadedSection {
+    uint32_t addr;
+    uint32_t size;
+};
 
 class Program {
 public:
-    static std::unique_ptr<std::ofstream> LOG;
-    std::vector<int32_t> gpr_registers = std::vector<int32_t>(15, 0);
-    std::vector<int32_t> csr_registers = std::vector<int32_t>(3, 0);
+    std::unique_ptr<std::ofstream> LOG;
+    std::vector<int32_t> gpr_registers = std::vector<int32_t>(16, 0);
+    std::vector<int32_t> csr_registers = std::vector<int32_t>(4, 0);
     Mnemonic currInstr{0};
     pthread_t keyboardThread;
     std::chrono::time_point<std::chrono::system_clock> executionStart;
     std::chrono::time_point<std::chrono::system_clock> lastTimerExecution;
+    std::chrono::nanoseconds timerPeriod = std::chrono::seconds(1);     // 0 turns the timer off
     std::unordered_map<int, std::function<void()> > instructionExecutors;
     std::unordered_map<int, std::function<bool()> > conditionTesters;
-
-    Memory memory;
+    std::vector<Observer *> observers;
+    std::vector<Observer *> memoryObservers;
+    std::vector<LoadedSection> sections;
+    EventLog *eventLog = nullptr;
+    BlockDevice *disk = nullptr;
+    Semihost *semihost = nullptr;
+    std::function<void(int32_t)> output;        // terminal output device, stdout unless replaced
+    std::atomic<char> keyboardBuf{0};
+    std::atomic<bool> keyBarrier{false};
+    std::set<uint32_t> breakpoints;
+    std::unordered_map<uint32_t, uint32_t> originalWords;     // every address a breakpoint was patched into
+
+    std::unique_ptr<Memory> ownMemory;
+    Memory &memory;                 // ownMemory, or the memory shared by all cores
     PSW psw;
     bool isEnd = false;
     bool incrementPC = true;
-    uint32_t instrCounter;
+    bool trace = true;
+    bool devices = false;
+    bool breakHit = false;
+    bool multiCore = false;         // polls its inter-processor interrupt mailbox
+    uint64_t instrCounter = 0;
+    int32_t exitStatus = 0;         // set by SEMI_EXIT
 
-    explicit Program();
+    explicit Program(const std::string &logFile = "log.txt", Memory *shared = nullptr);
 
     void setReg0();
 
@@ -41,8 +76,20 @@ public:
 
     int32_t &SP();
 
+    int32_t &COREID();
+
     void load(const std::string &);
 
+    void load(std::istream &);
+
+    void loadHex(const char *, size_t);
+
+    void loadZeroFill(uint32_t, uint32_t);
+
+    void saveState(std::ostream &) const;
+
+    void restoreState(std::istream &);
+
     int32_t pop();
 
     int32_t castToSign(int32_t, uint8_t);
@@ -61,17 +108,56 @@ public:
 
     void executeCurrent();
 
+    void step();
+
+    void advance();
+
+    void insertBreakpoints();
+
+    void removeBreakpoints();
+
+    void jump(int32_t);
+
     void logState();
 
+    void notifyCall(uint32_t);
+
+    void notifyReturn();
+
+    void notifyInterrupt(uint32_t, uint32_t);
+
+    void notifyExit();
+
+    // device transfers reach memory observers word by word, like the loads and stores they replace
+    void notifyRange(uint32_t, uint32_t, bool);
+
+    void addObserver(Observer *);
+
+    void startDevices();
+
+    void disableTrace();
+
     void handleInterrupts();
 
-    void timerInterrupt();
+    void handleIpi();
 
-    static void *KeyboardThread(void *);
+    void handleDma();
 
-    static volatile char keyboardBuf;
+    void attachDisk(BlockDevice *);
 
-    static volatile bool keyBarrier;
+    void handleDisk();
+
+    void handleSemihost();
+
+    void deliver(const DeviceEvent &);
+
+    void interrupt(uint32_t);
+
+    [[nodiscard]] bool isMasked(uint32_t);
+
+    bool timerInterrupt();
+
+    static void *KeyboardThread(void *);
 
     static uint32_t signExt(uint32_t, size_t);
 
@@ -79,7 +165,11 @@ public:
 
     int32_t getMemory(uint32_t);
 
-    void keyInterr();
+    int32_t exchangeMemory(uint32_t, int32_t);
+
+    int32_t compareExchangeMemory(uint32_t, int32_t, int32_t);
+
+    bool keyInterr(char);
 
     int32_t sum(int32_t, int32_t);
 
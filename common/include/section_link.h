@@ -6,6 +6,8 @@ class SectionLink {
 public:
     std::vector<uint8_t> data;
     std::string name;
+    uint32_t zeroFill = 0;          // zero bytes after data, counted in size() but never stored
+    std::vector<std::pair<uint32_t, uint32_t>> code;    // [start, end) of bytes written as instructions
 
     friend std::ostream &operator<<(std::ostream &, const SectionLink &);
 
@@ -28,6 +30,9 @@ public:
 
     void addToLocCounter(uint32_t);
 
+    // reserves zero bytes without storing them, anything written after them stores them after all
+    void skip(uint32_t);
+
     int32_t readWord(uint32_t);
 
     void write(const void *, uint32_t, uint32_t);
@@ -38,7 +43,12 @@ public:
 
     void append(const void *, uint32_t);
 
+    // extends the last range when it ends at the offset, literal pools and directives are left out
+    void markCode(uint32_t, uint32_t);
+
     [[nodiscard]] uint32_t locationCnt() const;
 
+    [[nodiscard]] uint32_t size() const;
+
 };
 
@@ -108,6 +108,8 @@ std::ostream &operator<<(std::ostream &out, enum REG_CSR csr) {
             return out << "handler";
         case CSR_CAUSE:
             return out << "cause";
+        case CSR_COREID:
+            return out << "coreid";
         default:
             throw std::runtime_error("REG_CSR operator<<: unknown " + std::to_string((uint32_t) csr));
     }
@@ -167,6 +169,10 @@ std::ostream &operator<<(std::ostream &out, enum INSTRUCTION instr) {
             return out << "BGT_MEM";
         case INSTRUCTION::XCHG:
             return out << "XCHG";
+        case INSTRUCTION::SWAP:
+            return out << "SWAP";
+        case INSTRUCTION::CAS:
+            return out << "CAS";
         case INSTRUCTION::ADD:
             return out << "ADD";
         case INSTRUCTION::SUB:
@@ -231,6 +237,27 @@ std::ostream &operator<<(std::ostream &out, RELOCATION rel) {
     }
 }
 
+std::ostream &operator<<(std::ostream &out, enum STATUS cause) {
+    switch (cause) {
+        case STATUS::FAULT:
+            return out << "FAULT";
+        case STATUS::TIMER:
+            return out << "TIMER";
+        case STATUS::TERMINAL:
+            return out << "TERMINAL";
+        case STATUS::SOFTWARE:
+            return out << "SOFTWARE";
+        case STATUS::IPI:
+            return out << "IPI";
+        case STATUS::DMA:
+            return out << "DMA";
+        case STATUS::DISK:
+            return out << "DISK";
+        default:
+            throw std::runtime_error("STATUS operator<<: unknown " + std::to_string((uint32_t) cause));
+    }
+}
+
 void displacementToBig(int32_t value) {
     throw std::runtime_error("Error: Displacement " + std::to_string(value) + " out of range.");
 }
@@ -72,7 +72,7 @@ Pop_Instr::Pop_Instr(uint8_t gpr)
 }
 
 Not_Instr::Not_Instr(uint8_t gpr)
-        : Instruction(INSTRUCTION::NOT, gpr) {}
+        : Instruction(INSTRUCTION::NOT, gpr, gpr) {}
 
 Int_Instr::Int_Instr()
         : Instruction(INSTRUCTION::INT) {}
@@ -91,16 +91,16 @@ Load_Instr::Load_Instr(Operand *operand, uint8_t gpr, Assembler *as)
         case CSR_OP: // CsrOp
             setMode(0b0000);
             break;
-        case REG_DIR: // RegDir, LiteralInDir, IdentImm
+        case REG_DIR: // RegDir, LiteralImm, RegInDirOffIdent
             setMode(0b0001);
             break;
-        case IN_DIR_OFFSET: // RegInDirOffIdent, RegInDir, LiteralInDir, IdentInDir
+        case IN_DIR_OFFSET: // RegInDirOffLiteral, RegInDir, LiteralInDir, LiteralImm and IdentImm from the pool
             setMode(0b0010);
             break;
-        case IN_DIR_INDEX: // RegInDirOffLiteral
+        case IN_DIR_INDEX:
             setMode(0b0011);
             break;
-        case IN_DIR_IN_DIR:
+        case IN_DIR_IN_DIR: // the address comes from the pool, a second load into the same register reads it
             isInDirInDir = true;
             setMode(0b0010);
             break;
@@ -109,19 +109,26 @@ Load_Instr::Load_Instr(Operand *operand, uint8_t gpr, Assembler *as)
     }
 }
 
-Load_Instr::Load_Instr(uint8_t gprD, uint8_t gprS, uint32_t offset)
-        : Instruction(INSTRUCTION::LD, gprD, gprS) {
+Load_Instr::Load_Instr(uint8_t gprAddr, uint8_t gprD, uint32_t offset)
+        : Instruction(INSTRUCTION::LD_IND, gprD, gprAddr) {
+    // MMMM==0b0010: gpr[A=gprD]<=mem32[gpr[B=gprAddr]+gpr[C=0]+D];
     setDisplacement(offset);
 }
 
 Csrwr_Instr::Csrwr_Instr(uint8_t gpr, uint8_t csr)
-        : Instruction(INSTRUCTION::CSR_LD, gpr, csr) {}
+        : Instruction(INSTRUCTION::CSR_LD, csr, gpr) {}
 
 Csrrd_Instr::Csrrd_Instr(uint8_t csr, uint8_t gpr)
-        : Instruction(INSTRUCTION::LD_CSR, csr, gpr) {}
+        : Instruction(INSTRUCTION::LD_CSR, gpr, csr) {}
 
 Xchg_Instr::Xchg_Instr(uint8_t regA, uint8_t regB)
-        : Instruction(INSTRUCTION::XCHG, regA, regB) {}
+        : Instruction(INSTRUCTION::XCHG, 0, regA, regB) {}
+
+Swap_Instr::Swap_Instr(uint8_t addr, uint8_t gpr)
+        : Instruction(INSTRUCTION::SWAP, addr, 0, gpr) {}
+
+Cas_Instr::Cas_Instr(uint8_t addr, uint8_t expected, uint8_t gpr)
+        : Instruction(INSTRUCTION::CAS, addr, expected, gpr) {}
 
 JmpCond_Instr::JmpCond_Instr(INSTRUCTION instr, uint8_t regS, uint8_t regD, Operand *operand, Assembler *as)
         : Instruction(instr) {
@@ -168,7 +175,6 @@ Call_Instr::Call_Instr(enum INSTRUCTION instruction, Operand *operand, Assembler
             // displacement will be set in by relocation
             break;
         case IN_DIR_IN_DIR:
-            isInDirInDir = true;
             setMode(0b0001);
             break;
         default:
@@ -198,8 +204,8 @@ Jmp_Instr::Jmp_Instr(enum INSTRUCTION instruction, Operand *operand, Assembler *
     }
 }
 
-TwoReg_Instr::TwoReg_Instr(enum INSTRUCTION instruction, uint8_t regD, uint8_t regS)
-        : Instruction(instruction, regD, regS, regS) {}
+TwoReg_Instr::TwoReg_Instr(enum INSTRUCTION instruction, uint8_t regS, uint8_t regD)
+        : Instruction(instruction, regD, regD, regS) {}
 
 Store_Instr::Store_Instr(uint8_t gpr, Operand *operand, Assembler *as)
         : Instruction(INSTRUCTION::ST) {
@@ -212,21 +218,17 @@ Store_Instr::Store_Instr(uint8_t gpr, Operand *operand, Assembler *as)
     setRegA(addressing.reg);
     setDisplacement((int32_t) addressing.value);
     switch (addressing.addressing) {
-        case REG_DIR:           // IdentImm, RegDir, LiteralInDir
+        case REG_DIR:           // RegDir, LiteralImm
+        case IN_DIR_OFFSET:     // RegInDirOffLiteral, RegInDir, LiteralInDir
             // MMMM==0b0000: mem32[gpr[A=reg]+gpr[B=0]+D]<=gpr[C=gpr];
             setMode(0b0000);
             break;
-        case IN_DIR_OFFSET:     // RegInDirOffIdent, RegInDir, LiteralInDir, IdentInDir
-            // MMMM==0b0010: mem32[mem32[gpr[A=PC]+gpr[B=0]+D]]<=gpr[C];
-            // st [PC+off], %r1;
-            setMode(0b0010);
-            break;
-        case IN_DIR_INDEX:      // RegInDirOffLiteral: // st [%r1+0], %r2
+        case IN_DIR_INDEX:
             // MMMM==0b0001: gpr[A]<=gpr[A]+D; mem32[gpr[A]]<=gpr[C];
             setMode(0b0001);
             break;
-        case IN_DIR_IN_DIR:
-            isInDirInDir = true;
+        case IN_DIR_IN_DIR:     // LiteralInDir, IdentInDir, the address is in the pool
+            // MMMM==0b0010: mem32[mem32[gpr[A=PC]+gpr[B=0]+D]]<=gpr[C];
             setMode(0b0010);
             break;
         default:
@@ -234,8 +236,9 @@ Store_Instr::Store_Instr(uint8_t gpr, Operand *operand, Assembler *as)
     }
 }
 
-Store_Instr::Store_Instr(uint8_t gprD, int16_t offset, uint8_t gprS)
-        : Instruction(INSTRUCTION::ST, gprD, gprS) {
+Store_Instr::Store_Instr(uint8_t gprS, uint8_t gprAddr, int16_t offset)
+        : Instruction(INSTRUCTION::ST, gprAddr, 0, gprS) {
+    // MMMM==0b0000: mem32[gpr[A=gprAddr]+gpr[B=0]+D]<=gpr[C=gprS];
     setDisplacement(offset);
 }
 
@@ -252,23 +255,12 @@ Instruction::Instruction(uint32_t value) {
 }
 
 void Instruction::insertInstr(Assembler *as) {
+    as->insertInstr(this);
     if (isInDirInDir) {
-        // push GPR_TEMP
-        as->insertInstr(std::make_unique<Push_Instr>((uint8_t) GPR_TEMP).get());
-
-        // MMMM==0b0010: gpr[A=GPR_TEMP]<=mem32[gpr[B=PC]+gpr[C=0]+D];
-        auto loadInstr = std::make_unique<Load_Instr>((uint8_t) GPR_TEMP, REG_PC, 0);
-        loadInstr->setMode(0b0010);
-        as->insertInstr(this);
-
-        // insert instr
-        as->insertInstr(this);
-
-        // pop GPR_TEMP
-        as->insertInstr(std::make_unique<Pop_Instr>((uint8_t) GPR_TEMP).get());
-        return;
+        // MMMM==0b0010: gpr[A]<=mem32[gpr[B=A]+gpr[C=0]+0]; the first load brought the address
+        Instruction value(INSTRUCTION::LD_IND, bytes.REG_A, bytes.REG_A);
+        as->insertInstr(&value);
     }
-    as->insertInstr(this);
 }
 
 std::ostream &Instruction::logExecute(std::ostream &out) const {
@@ -279,9 +271,11 @@ std::ostream &Instruction::logExecute(std::ostream &out) const {
 }
 
 IRet_Instr::IRet_Instr()
-        : Instruction(INSTRUCTION::LD_POST_INC, REG_PC, REG_SP, 0, 4) {}
+        : Instruction(INSTRUCTION::LD_POST_INC, REG_PC, REG_SP, 0, 8) {}
 
 void IRet_Instr::insertInstr(Assembler *as) {
+    // status was pushed before the return address, it is read first and both are popped with the pc
+    Instruction status(INSTRUCTION::CSR_LD_IND, CSR_STATUS, REG_SP, 0, 4);
+    as->insertInstr(&status);
     as->insertInstr(this);
-    as->insertInstr(std::make_unique<Pop_Instr>((uint8_t) CSR_STATUS).get());
 }
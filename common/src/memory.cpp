@@ -1,22 +1,22 @@
 #include "../include/memory.h"
+#include "../include/log.h"
 
 #include <cstring>
 #include <algorithm>
 #include <stdexcept>
+#include <iomanip>
+#include <sys/mman.h>
 
-Segment::Segment(uint32_t size) {
-    data.resize(size);
+SegmentBytes &SegmentBytes::operator=(const std::vector<uint8_t> &other) {
+    if (other.size() != length)
+        throw std::runtime_error("Segment size mismatch!");
+    std::memcpy(bytes, other.data(), length);
+    return *this;
 }
 
-int32_t Segment::readWord(uint32_t offset) const {
-    uint32_t ret;
-    std::memcpy(&ret, data.data() + offset, sizeof(ret));
-    return ret;
-}
+Segment::Segment(uint32_t size) : data(size) {}
 
-void Segment::writeWord(uint32_t offset, uint32_t value) const {
-    std::memcpy((void *) (data.data() + offset), &value, sizeof(value));
-}
+Segment::Segment(uint8_t *mapped, uint32_t size) : data(mapped, size) {}
 
 Memory::Memory(uint64_t minAddr, uint64_t size, uint32_t segmentSize)
         : _minAddr(minAddr), _size(size), _segmentSize(segmentSize) {
@@ -29,33 +29,155 @@ bool Memory::isAddrValid(uint32_t addr) const {
 }
 
 Segment &Memory::getSegment(uint32_t index) {
+    if (concurrent) {
+        // segments are never freed while shared, only their creation has to be exclusive
+        {
+            std::shared_lock<std::shared_mutex> lock(segmentsMutex);
+            auto it = _segments.find(index);
+            if (it != _segments.end())
+                return *it->second;
+        }
+        std::unique_lock<std::shared_mutex> lock(segmentsMutex);
+        auto &segment = _segments[index];
+        if (!segment)
+            segment = allocate(index);
+        return *segment;
+    }
     if (_segments.find(index) == _segments.end())
-        _segments[index] = std::make_unique<Segment>(_segmentSize);
+        _segments[index] = allocate(index);
     return *_segments[index];
 }
 
+std::unique_ptr<Segment> Memory::allocate(uint32_t index) {
+    if (backing == RAM_SEGMENTS)
+        return std::make_unique<Segment>(_segmentSize);
+    // neighbouring segments share a region, the host sees guest RAM in huge contiguous pieces
+    uint64_t offset = (uint64_t) index * _segmentSize;
+    return std::make_unique<Segment>(region(offset / HUGE_REGION_SIZE) + offset % HUGE_REGION_SIZE, _segmentSize);
+}
+
+uint8_t *Memory::region(uint32_t number) {
+    auto &region = _regions[number];
+    if (region)
+        return static_cast<uint8_t *>(region.get());
+    void *bytes = MAP_FAILED;
+    if (backing == RAM_HUGETLB)
+        bytes = mmap(nullptr, HUGE_REGION_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+                     -1, 0);
+    if (bytes == MAP_FAILED) {
+        // a huge page needs an aligned region, the slack on both sides goes back
+        auto *mapped = static_cast<uint8_t *>(mmap(nullptr, 2 * HUGE_REGION_SIZE, PROT_READ | PROT_WRITE,
+                                                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        if (mapped == MAP_FAILED)
+            throw std::runtime_error("Out of memory!");
+        auto *aligned = reinterpret_cast<uint8_t *>(
+                ((uintptr_t) mapped + HUGE_REGION_SIZE - 1) & ~((uintptr_t) HUGE_REGION_SIZE - 1));
+        if (aligned != mapped)
+            munmap(mapped, aligned - mapped);
+        munmap(aligned + HUGE_REGION_SIZE, mapped + HUGE_REGION_SIZE - aligned);
+        if (backing == RAM_TRANSPARENT_HUGE)
+            madvise(aligned, HUGE_REGION_SIZE, MADV_HUGEPAGE);
+        bytes = aligned;
+    }
+    region = std::shared_ptr<void>(bytes, [](void *addr) { munmap(addr, HUGE_REGION_SIZE); });
+    return static_cast<uint8_t *>(bytes);
+}
+
+void Memory::useHugePages() {
+    // probes with one region, the pool of MAP_HUGETLB pages is empty unless the administrator reserved some
+    auto *probe = mmap(nullptr, HUGE_REGION_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+                       -1, 0);
+    if (probe != MAP_FAILED) {
+        munmap(probe, HUGE_REGION_SIZE);
+        backing = RAM_HUGETLB;
+        return;
+    }
+    backing = RAM_REGIONS;
+    probe = mmap(nullptr, HUGE_REGION_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (probe == MAP_FAILED)
+        return;
+    if (madvise(probe, HUGE_REGION_SIZE, MADV_HUGEPAGE) == 0)
+        backing = RAM_TRANSPARENT_HUGE;
+    munmap(probe, HUGE_REGION_SIZE);
+}
+
+const char *Memory::backingName() const {
+    switch (backing) {
+        case RAM_REGIONS:
+            return "2 MiB regions";
+        case RAM_TRANSPARENT_HUGE:
+            return "transparent huge pages";
+        case RAM_HUGETLB:
+            return "hugetlb pages";
+        default:
+            return "segments";
+    }
+}
+
+void Memory::report(std::ostream &out) const {
+    Log::tableName(out, "Memory");
+    out << std::left << std::dec
+        << std::setw(25) << "Backing" << backingName() << "\n"
+        << std::setw(25) << "Segment size" << _segmentSize << "\n";
+    if (backing != RAM_SEGMENTS)
+        out << std::setw(25) << "Region size" << HUGE_REGION_SIZE << "\n";
+    Log::tableFooter(out);
+}
+
 void Memory::writeWord(uint32_t addr, uint32_t value) {
     auto index = getSegmentIndex(addr);
     auto &segment = getSegment(index);
     auto offset = addr % _segmentSize;
+    // one compare on the common path, dirty and not watched
+    if (segment.flags != SEG_DIRTY)
+        touch(index, segment, addr);
 
     // Check if the word spans across two segments
     if (offset + 4 > _segmentSize) {
         auto &nextSegment = getSegment(index + 1);
+        if (nextSegment.flags != SEG_DIRTY)
+            touch(index + 1, nextSegment, addr);
 
         // Calculate the number of bytes to write in the current segment
         auto bytesInCurrentSegment = _segmentSize - offset;
 
+        // byte-wise, segments can be borrowed from a mapping and have no slack after their last byte
+        auto *bytes = reinterpret_cast<const uint8_t *>(&value);
+
         // Write the part to the current segment
-        segment.writeWord(offset, value & ((1 << (8 * bytesInCurrentSegment)) - 1));
+        std::memcpy(segment.data.data() + offset, bytes, bytesInCurrentSegment);
 
         // Write the part to the next segment
-        nextSegment.writeWord(0, value >> (8 * bytesInCurrentSegment));
+        std::memcpy(nextSegment.data.data(), bytes + bytesInCurrentSegment, 4 - bytesInCurrentSegment);
     } else
         // Write the word within a single segment
         segment.writeWord(offset, value);
 }
 
+int32_t Memory::exchange(uint32_t addr, uint32_t value) {
+    if (addr % 4 != 0)
+        throw std::runtime_error("Unaligned atomic address!");
+    auto index = getSegmentIndex(addr);
+    auto &segment = getSegment(index);
+    if (segment.flags != SEG_DIRTY)
+        touch(index, segment, addr);
+    auto *word = reinterpret_cast<uint32_t *>(segment.data.data() + addr % _segmentSize);
+    return __atomic_exchange_n(word, value, __ATOMIC_SEQ_CST);
+}
+
+int32_t Memory::compareExchange(uint32_t addr, uint32_t expected, uint32_t value) {
+    if (addr % 4 != 0)
+        throw std::runtime_error("Unaligned atomic address!");
+    auto index = getSegmentIndex(addr);
+    auto &segment = getSegment(index);
+    if (segment.flags != SEG_DIRTY)
+        touch(index, segment, addr);
+    auto *word = reinterpret_cast<uint32_t *>(segment.data.data() + addr % _segmentSize);
+    // expected is overwritten with the old value when the compare fails
+    __atomic_compare_exchange_n(word, &expected, value, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return expected;
+}
+
 uint32_t Memory::getSegmentIndex(uint32_t addr) const {
     if (!isAddrValid(addr))
         throw std::runtime_error("Invalid address!");
@@ -98,8 +220,211 @@ void Memory::loadMemory(uint32_t startAddr, std::vector<uint8_t> &data) {
         auto &segment = getSegment(index);
         auto offset = currentAddr % _segmentSize;
         auto bytesToCopy = std::min(_segmentSize - offset, remainingBytes);
+        markDirty(index, segment);
         std::memcpy(segment.data.data() + offset, data.data() + (memorySize - remainingBytes), bytesToCopy);
         remainingBytes -= bytesToCopy;
         currentAddr += bytesToCopy;
     }
-}
\ No newline at end of file
+}
+void Memory::mapMemory(uint32_t startAddr, uint8_t *bytes, uint32_t size, const std::shared_ptr<void> &mapping) {
+    // segments wholly inside the range use the mapped bytes in place, a private mapping turns guest writes
+    // into copy-on-write pages; partial or unaligned segments and segments that already exist are copied
+    uint32_t offset = 0;
+    while (offset < size) {
+        auto addr = startAddr + offset;
+        auto index = getSegmentIndex(addr);
+        auto inSegment = addr % _segmentSize;
+        auto length = std::min(_segmentSize - inSegment, size - offset);
+        // swap and cas need aligned host words, an image section can start at any file offset
+        auto aligned = reinterpret_cast<uintptr_t>(bytes + offset) % alignof(uint32_t) == 0;
+        if (inSegment == 0 && length == _segmentSize && aligned && !_segments.count(index)) {
+            _segments[index] = std::make_unique<Segment>(bytes + offset, _segmentSize);
+            markDirty(index, *_segments[index]);
+        } else {
+            auto &segment = getSegment(index);
+            markDirty(index, segment);
+            std::memcpy(segment.data.data() + inSegment, bytes + offset, length);
+        }
+        offset += length;
+    }
+    if (std::find(_mappings.begin(), _mappings.end(), mapping) == _mappings.end())
+        _mappings.push_back(mapping);
+}
+
+void Memory::zeroMemory(uint32_t startAddr, uint32_t size) {
+    uint32_t offset = 0;
+    while (offset < size) {
+        auto addr = startAddr + offset;
+        auto index = getSegmentIndex(addr);
+        auto inSegment = addr % _segmentSize;
+        auto length = std::min(_segmentSize - inSegment, size - offset);
+        auto found = _segments.find(index);
+        if (found != _segments.end()) {
+            markDirty(index, *found->second);
+            std::memset(found->second->data.data() + inSegment, 0, length);
+        }
+        offset += length;
+    }
+}
+
+bool Memory::isRangeValid(uint32_t addr, uint32_t length) const {
+    return !length || (isAddrValid(addr) && (uint64_t) addr + length <= _minAddr + _size);
+}
+
+void Memory::checkRange(uint32_t addr, uint32_t length) const {
+    if (!isRangeValid(addr, length))
+        throw std::runtime_error("Invalid address!");
+}
+
+void Memory::readBytes(uint32_t addr, uint8_t *bytes, uint32_t length) {
+    checkRange(addr, length);
+    uint32_t offset = 0;
+    while (offset < length) {
+        auto index = getSegmentIndex(addr + offset);
+        auto inSegment = (addr + offset) % _segmentSize;
+        auto chunk = std::min(_segmentSize - inSegment, length - offset);
+        std::memcpy(bytes + offset, getSegment(index).data.data() + inSegment, chunk);
+        offset += chunk;
+    }
+}
+
+void Memory::writeBytes(uint32_t addr, const uint8_t *bytes, uint32_t length) {
+    checkRange(addr, length);
+    uint32_t offset = 0;
+    while (offset < length) {
+        auto index = getSegmentIndex(addr + offset);
+        auto &segment = getSegment(index);
+        auto inSegment = (addr + offset) % _segmentSize;
+        auto chunk = std::min(_segmentSize - inSegment, length - offset);
+        if (segment.flags != SEG_DIRTY)
+            touch(index, segment, addr + offset);
+        std::memcpy(segment.data.data() + inSegment, bytes + offset, chunk);
+        offset += chunk;
+    }
+}
+
+void Memory::copyMemory(uint32_t dst, uint32_t src, uint32_t length) {
+    // through a bounded buffer, from the end when the destination overlaps the tail of the source
+    constexpr uint32_t bufferSize = 64 * 1024;
+    checkRange(src, length);
+    checkRange(dst, length);
+    std::vector<uint8_t> buffer(std::min(length, bufferSize));
+    bool backward = dst > src && dst - src < length;
+    for (uint32_t done = 0; done < length;) {
+        auto chunk = std::min(bufferSize, length - done);
+        auto offset = backward ? length - done - chunk : done;
+        readBytes(src + offset, buffer.data(), chunk);
+        writeBytes(dst + offset, buffer.data(), chunk);
+        done += chunk;
+    }
+}
+
+void Memory::fillMemory(uint32_t addr, uint8_t value, uint32_t length) {
+    checkRange(addr, length);
+    uint32_t offset = 0;
+    while (offset < length) {
+        auto index = getSegmentIndex(addr + offset);
+        auto &segment = getSegment(index);
+        auto inSegment = (addr + offset) % _segmentSize;
+        auto chunk = std::min(_segmentSize - inSegment, length - offset);
+        if (segment.flags != SEG_DIRTY)
+            touch(index, segment, addr + offset);
+        std::memset(segment.data.data() + inSegment, value, chunk);
+        offset += chunk;
+    }
+}
+
+void Memory::markDirty(uint32_t index, Segment &segment) {
+    if (segment.flags & SEG_DIRTY)
+        return;
+    std::unique_lock<std::shared_mutex> lock(segmentsMutex, std::defer_lock);
+    if (concurrent) {
+        lock.lock();
+        if (segment.flags & SEG_DIRTY)
+            return;
+    }
+    segment.flags |= SEG_DIRTY;
+    _dirtySegments.push_back(index);
+    if (!_written.empty())
+        _written[index] = true;
+}
+
+void Memory::touch(uint32_t index, Segment &segment, uint32_t addr) {
+    markDirty(index, segment);
+    if ((segment.flags & SEG_WATCHED) && watchHandler)
+        watchHandler(addr);
+    if ((segment.flags & SEG_CODE) && codeWriteHandler)
+        codeWriteHandler(addr);
+}
+
+void Memory::patchWord(uint32_t addr, uint32_t value) {
+    // not a guest write, neither dirty nor watched
+    if (addr % 4 != 0)
+        throw std::runtime_error("Unaligned patch address!");
+    getSegment(getSegmentIndex(addr)).writeWord(addr % _segmentSize, value);
+}
+
+void Memory::setFlags(uint32_t addr, uint32_t len, uint8_t flags) {
+    // page granularity, handlers check the exact range
+    for (auto index = getSegmentIndex(addr); index <= getSegmentIndex(addr + len - 1); ++index)
+        getSegment(index).flags |= flags;
+}
+
+void Memory::clearFlags(uint8_t flags) {
+    for (auto &segment: _segments)
+        segment.second->flags &= ~flags;
+}
+
+std::vector<uint32_t> Memory::takeDirty() {
+    // segments written since the previous call
+    std::vector<uint32_t> dirty;
+    dirty.swap(_dirtySegments);
+    for (auto index: dirty)
+        _segments.at(index)->flags &= ~SEG_DIRTY;
+    return dirty;
+}
+
+void Memory::trackWrites() {
+    // markDirty sees every segment again once its dirty flag is gone, later takeDirty() calls keep it that way
+    takeDirty();
+    _written.assign(_size / _segmentSize, false);
+}
+
+std::vector<uint32_t> Memory::writtenSegments() const {
+    std::vector<uint32_t> indexes;
+    for (uint32_t index = 0; index < _written.size(); ++index)
+        if (_written[index])
+            indexes.push_back(index);
+    return indexes;
+}
+
+void Memory::save(std::ostream &out) const {
+    // all-zero segments are left out, they read back as zero anyway
+    std::vector<uint32_t> indexes;
+    for (auto &segment: _segments)
+        if (std::any_of(segment.second->data.begin(), segment.second->data.end(), [](uint8_t b) { return b != 0; }))
+            indexes.push_back(segment.first);
+    uint32_t numSegments = indexes.size();
+    out.write(reinterpret_cast<const char *>(&numSegments), sizeof(numSegments));
+    for (auto index: indexes) {
+        out.write(reinterpret_cast<const char *>(&index), sizeof(index));
+        out.write(reinterpret_cast<const char *>(_segments.at(index)->data.data()), _segmentSize);
+    }
+}
+
+void Memory::restore(std::istream &in) {
+    _segments.clear();
+    _dirtySegments.clear();
+    // regions still hold the bytes of the dropped segments
+    _regions.clear();
+    ++generation;
+    uint32_t numSegments;
+    in.read(reinterpret_cast<char *>(&numSegments), sizeof(numSegments));
+    for (uint32_t i = 0; i < numSegments && in; ++i) {
+        uint32_t index;
+        in.read(reinterpret_cast<char *>(&index), sizeof(index));
+        auto &segment = getSegment(index);
+        in.read(reinterpret_cast<char *>(segment.data.data()), _segmentSize);
+        markDirty(index, segment);
+    }
+}
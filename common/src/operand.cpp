@@ -6,6 +6,7 @@
 #include "../../assembler/include/assembler.h"
 
 #include <iostream>
+#include <cstring>
 
 void WordOperand::log(std::ostream &out) {
     WordOperand *current = this;
@@ -23,44 +24,25 @@ Addressing WordLiteral::addRelocation(Assembler *as) {
 }
 
 Addressing WordIdent::addRelocation(Assembler *as) {
-    // If operand is label
+    // the word holds the address of the label, the linker writes it; equ values are known here
     auto label = stringValue();
     auto symbol = as->findSymbol(label);
-
-    if (symbol.index != -1) {
-        // symbols defined in other files goes to relocations
-        if (symbol.symbol->core.flags.source == OTHER) {
-            auto relType = as->getRelocationType(symbol.symbol, true);
-            as->relocations.emplace_back(std::make_unique<Relocation>(
-                    symbol.symbol->core.name,
-                    symbol.index,
-                    as->currSection,
-                    as->sections[as->currSection]->core.locationCnt(),
-                    relType
-            ));
-            as->sections[as->currSection]->core.addToLocCounter(4);
-        } else {
-            // if symbol is not defined, add it to wordBackPatch
-            if (!symbol.symbol->core.flags.defined) {
-                auto addrToFill =
-                        as->sections[as->currSection]->core.data.data() +
-                        as->sections[as->currSection]->core.locationCnt();
-                as->wordBackPatch[symbol.symbol].push_back(addrToFill);
-                as->sections[as->currSection]->core.addToLocCounter(4);
-            } else {
-                // symbol is defined, writeAndIncr it
-                void *ptr;
-                // if not equ
-                if (symbol.symbol->core.flags.symbolType != EQU) {
-                    auto section = as->sections[symbol.symbol->core.sectionIndex].get();
-                    ptr = section->core.data.data() + symbol.symbol->core.offset;
-                } else
-                    ptr = &symbol.symbol->core.offset;
-                as->sections[as->currSection]->core.append(ptr, 4);
-            }
-        }
-    } else
-        throw std::runtime_error("Error: Symbol " + label + " have to be declared.");
+    if (!Assembler::isSymbolDeclared(symbol))
+        symbol = as->declareSymbol(label);
+    auto &core = as->sections[as->currSection]->core;
+    if (Assembler::isSymbolDefined(symbol) && symbol.symbol->core.flags.symbolType == EQU) {
+        core.append(&symbol.symbol->core.offset, 4);
+        return {ADDR_UND, 0};
+    }
+    as->relocations.emplace_back(std::make_unique<Relocation>(
+            symbol.symbol->core.name,
+            symbol.index,
+            as->currSection,
+            core.locationCnt(),
+            R_32_IN_DIR
+    ));
+    uint32_t fill = 0;
+    core.append(&fill, 4);
     return {ADDR_UND, 0};
 }
 
@@ -128,7 +110,8 @@ void LiteralImm::log(std::ostream &out) {
 }
 
 Addressing LiteralImm::addRelocation(Assembler *as) {
-    if (fitIn12Bits(value))
+    // jump targets are absolute, they always come from the pool
+    if (!as->parsingJmp && fitIn12Bits(value))
         return {REG_DIR, value};
     as->addRelLiteral(value);
     return {IN_DIR_OFFSET, 0, REG_PC};
@@ -141,8 +124,8 @@ void LiteralInDir::log(std::ostream &out) {
 Addressing LiteralInDir::addRelocation(Assembler *as) {
     if (fitIn12Bits(value))
         return {IN_DIR_OFFSET, value};
-    as->addRelLiteral(value, 4);
-    return {IN_DIR_IN_DIR, 0, GPR_TEMP};
+    as->addRelLiteral(value);
+    return {IN_DIR_IN_DIR, 0, REG_PC};
 }
 
 void RegInDir::log(std::ostream &out) {
@@ -168,7 +151,7 @@ void RegInDirOffLiteral::log(std::ostream &out) {
 Addressing RegInDirOffLiteral::addRelocation(Assembler *as) {
     if (!fitIn12Bits((int32_t) offset))
         displacementToBig((int32_t) offset);
-    return {IN_DIR_INDEX, offset};
+    return {IN_DIR_OFFSET, offset, gpr};
 }
 
 void RegInDirOffIdent::log(std::ostream &out) {
@@ -233,17 +216,9 @@ Addressing IdentImm::addRelocation(Assembler *as) {
     auto indexSymbol = as->findSymbol(ident);
     if (!as->isSymbolDeclared(indexSymbol))
         indexSymbol = as->declareSymbol(ident);
-    else if (Assembler::isSymbolDefined(indexSymbol)) {
-        uint32_t value = 0;
-        if (indexSymbol.symbol->core.flags.symbolType == EQU)
-            value = as->getValueOfSymbol(indexSymbol.symbol);
-        else if (indexSymbol.symbol->core.sectionIndex == as->currSection)
-            value = indexSymbol.symbol->core.offset - as->sections[as->currSection]->core.locationCnt();
-        if (fitIn12Bits(value))
-            return {REG_DIR, value};
-        as->addRelLiteral(value);
-        return {IN_DIR_OFFSET, 0, REG_PC};
-    }
+    else if (Assembler::isSymbolDefined(indexSymbol) && indexSymbol.symbol->core.flags.symbolType == EQU)
+        return LiteralImm(as->getValueOfSymbol(indexSymbol.symbol)).addRelocation(as);
+    // labels are addresses known only after linking, they are loaded from the pool
     as->addRelSymbol(indexSymbol);
     return {IN_DIR_OFFSET, 0, REG_PC};
 }
@@ -252,18 +227,8 @@ Addressing IdentInDir::addRelocation(Assembler *as) {
     auto indexSymbol = as->findSymbol(ident);
     if (!as->isSymbolDeclared(indexSymbol))
         indexSymbol = as->declareSymbol(ident);
-    else if (Assembler::isSymbolDefined(indexSymbol)) {
-        uint32_t value = 0;
-        if (indexSymbol.symbol->core.flags.symbolType == EQU)
-            value = as->getValueOfSymbol(indexSymbol.symbol);
-        else if (indexSymbol.symbol->core.sectionIndex == as->currSection)
-            value = indexSymbol.symbol->core.offset - as->sections[as->currSection]->core.locationCnt();
-        if (fitIn12Bits(value))
-            return {IN_DIR_OFFSET, value};
-        as->addRelLiteral(value, 4);
-        return {IN_DIR_IN_DIR, 0, GPR_TEMP};
-    }
-    as->addRelSymbol(indexSymbol, 4);
-    return {IN_DIR_IN_DIR, 0, GPR_TEMP};
+    else if (Assembler::isSymbolDefined(indexSymbol) && indexSymbol.symbol->core.flags.symbolType == EQU)
+        return LiteralInDir(as->getValueOfSymbol(indexSymbol.symbol)).addRelocation(as);
+    as->addRelSymbol(indexSymbol);
+    return {IN_DIR_IN_DIR, 0, REG_PC};
 }
-
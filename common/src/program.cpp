@@ -1,28 +1,176 @@
 #include "../include/program.h"
 #include "../../emulator/include/emulator.h"
+#include "../../emulator/include/observer.h"
+#include "../../emulator/include/event_log.h"
+#include "../../emulator/include/block_device.h"
+#include "../../emulator/include/semihost.h"
 
 #include <iostream>
 #include <cstring>
 #include <cstdint>
 #include <iomanip>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace {
+    // value of every character as a hex digit, -1 for anything else
+    struct HexTable {
+        int8_t value[256];
+
+        constexpr HexTable() : value() {
+            for (auto &digit: value)
+                digit = -1;
+            for (int c = '0'; c <= '9'; ++c)
+                value[c] = (int8_t) (c - '0');
+            for (int c = 'a'; c <= 'f'; ++c)
+                value[c] = (int8_t) (c - 'a' + 10);
+            for (int c = 'A'; c <= 'F'; ++c)
+                value[c] = (int8_t) (c - 'A' + 10);
+        }
+    };
 
-volatile char Program::keyboardBuf;
-volatile bool Program::keyBarrier;
-std::unique_ptr<std::ofstream> Program::LOG = nullptr;
+    constexpr HexTable HEX_TABLE;
+    constexpr size_t HEX_RUN_MAX = 64 * 1024;
+}
 
-Program::Program() : memory(MIN_ADDRESS, MEM_SIZE, SEGMENT_SIZE) {
-    LOG = std::make_unique<std::ofstream>("log.txt");
+Program::Program(const std::string &logFile, Memory *shared)
+        : ownMemory(shared ? nullptr : std::make_unique<Memory>(MIN_ADDRESS, MEM_SIZE, SEGMENT_SIZE)),
+          memory(shared ? *shared : *ownMemory) {
+    // without a log file the stream stays closed and every write to it is a no-op
+    LOG = std::make_unique<std::ofstream>();
+    if (!logFile.empty()) {
+        LOG->open(logFile);
+        if (!LOG->is_open())
+            throw std::runtime_error("Could not open log file!");
+    }
     PC() = DEFAULT_PC;
     SP() = DEFAULT_SP;
-    if (!LOG->is_open())
-        throw std::runtime_error("Could not open log file!");
+    output = [](int32_t state) {
+        std::cout << state;
+        std::cout.flush();
+    };
 }
 
 void Program::load(const std::string &inputFile) {
-    std::ifstream file(inputFile);
-    if (!file.is_open())
+    // the image is mapped privately, whole segments of it become guest memory without a copy
+    auto fd = open(inputFile.c_str(), O_RDONLY);
+    if (fd < 0)
         throw std::runtime_error("Could not open file " + inputFile);
+    struct stat st{};
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(uint32_t)) {
+        close(fd);
+        throw std::runtime_error("Not an image " + inputFile);
+    }
+    size_t size = st.st_size;
+    auto *image = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED)
+        throw std::runtime_error("Could not map file " + inputFile);
+    std::shared_ptr<void> mapping(image, [size](void *addr) { munmap(addr, size); });
+
+    auto *bytes = static_cast<uint8_t *>(image);
+    // the linker's -hex output starts with a comment, hand written dumps are recognised by the name
+    if (bytes[0] == '#' || (inputFile.size() > 4 && inputFile.compare(inputFile.size() - 4, 4, ".hex") == 0)) {
+        loadHex(reinterpret_cast<const char *>(bytes), size);
+        return;
+    }
+    auto read = [&](size_t pos) {
+        uint32_t value;
+        if (pos + sizeof(value) > size)
+            throw std::runtime_error("Truncated image " + inputFile);
+        std::memcpy(&value, bytes + pos, sizeof(value));
+        return value;
+    };
+    auto numSections = read(0);
+    size_t pos = sizeof(numSections);
+    for (uint32_t i = 0; i < numSections; ++i) {
+        auto startAddr = read(pos);
+        auto segmentSize = read(pos + sizeof(startAddr));
+        pos += sizeof(startAddr) + sizeof(segmentSize);
+        if (segmentSize & ZERO_FILL_FLAG) {
+            loadZeroFill(startAddr, segmentSize & ~ZERO_FILL_FLAG);
+            continue;
+        }
+        if (pos + segmentSize > size)
+            throw std::runtime_error("Truncated image " + inputFile);
+        memory.mapMemory(startAddr, bytes + pos, segmentSize, mapping);
+        sections.push_back({startAddr, segmentSize});
+        pos += segmentSize;
+    }
+}
 
+void Program::loadHex(const char *text, size_t size) {
+    // lines are "address: bytes |ascii|", decoding stops at the first token that is not two hex digits,
+    // that is the ascii column or the padding of the last line; contiguous lines are copied in one run
+    const auto *p = reinterpret_cast<const uint8_t *>(text);
+    const auto *end = p + size;
+    std::vector<uint8_t> run;
+    run.reserve(HEX_RUN_MAX);
+    uint32_t runStart = 0;
+    auto flush = [&]() {
+        if (run.empty())
+            return;
+        memory.loadMemory(runStart, run);
+        if (!sections.empty() && sections.back().addr + sections.back().size == runStart)
+            sections.back().size += run.size();
+        else
+            sections.push_back({runStart, (uint32_t) run.size()});
+        runStart += run.size();
+        run.clear();
+    };
+    auto skipLine = [&]() {
+        while (p < end && *p != '\n')
+            ++p;
+    };
+    while (p < end) {
+        if (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') {
+            ++p;
+            continue;
+        }
+        if (*p == '#') {
+            skipLine();
+            continue;
+        }
+        uint32_t addr = 0;
+        auto *digits = p;
+        for (int8_t digit; p < end && (digit = HEX_TABLE.value[*p]) >= 0; ++p)
+            addr = addr << 4 | digit;
+        if (p == digits || p == end || *p != ':')
+            throw std::runtime_error("Malformed hex line at offset " + std::to_string(digits - (const uint8_t *) text));
+        ++p;
+        if (addr != runStart + run.size() || run.size() >= HEX_RUN_MAX) {
+            flush();
+            runStart = addr;
+        }
+        while (true) {
+            while (p < end && (*p == ' ' || *p == '\t'))
+                ++p;
+            if (end - p < 2)
+                break;
+            auto high = HEX_TABLE.value[p[0]];
+            auto low = HEX_TABLE.value[p[1]];
+            if ((high | low) < 0)
+                break;
+            run.push_back((uint8_t) (high << 4 | low));
+            p += 2;
+        }
+        skipLine();
+    }
+    flush();
+}
+
+void Program::loadZeroFill(uint32_t startAddr, uint32_t size) {
+    // nothing is allocated, untouched memory reads as zero; a section usually continues the one before it
+    memory.zeroMemory(startAddr, size);
+    if (!sections.empty() && sections.back().addr + sections.back().size == startAddr)
+        sections.back().size += size;
+    else
+        sections.push_back({startAddr, size});
+}
+
+void Program::load(std::istream &file) {
     uint32_t numSections;
     auto tempVector = std::vector<uint8_t>();
     file.read(reinterpret_cast<char *>(&numSections), sizeof(numSections));
@@ -31,11 +179,58 @@ void Program::load(const std::string &inputFile) {
         file.read(reinterpret_cast<char *>(&startAddr), sizeof(startAddr));
         uint32_t segmentSize;
         file.read(reinterpret_cast<char *>(&segmentSize), sizeof(segmentSize));
+        if (segmentSize & ZERO_FILL_FLAG) {
+            loadZeroFill(startAddr, segmentSize & ~ZERO_FILL_FLAG);
+            continue;
+        }
         tempVector.resize(segmentSize);
         file.read(reinterpret_cast<char *>(tempVector.data()), segmentSize);
         memory.loadMemory(startAddr, tempVector);
+        sections.push_back({startAddr, segmentSize});
     }
-    file.close();
+}
+
+void Program::saveState(std::ostream &out) const {
+    // registers, psw, virtual clock and devices, loaded sections, then the non-zero memory segments
+    uint32_t magic = SNAPSHOT_MAGIC;
+    out.write(reinterpret_cast<const char *>(&magic), sizeof(magic));
+    out.write(reinterpret_cast<const char *>(gpr_registers.data()), gpr_registers.size() * sizeof(int32_t));
+    out.write(reinterpret_cast<const char *>(csr_registers.data()), csr_registers.size() * sizeof(int32_t));
+    out.write(reinterpret_cast<const char *>(&psw.val), sizeof(psw.val));
+    out.write(reinterpret_cast<const char *>(&instrCounter), sizeof(instrCounter));
+    int64_t sinceTimer = std::chrono::nanoseconds(std::chrono::system_clock::now() - lastTimerExecution).count();
+    out.write(reinterpret_cast<const char *>(&sinceTimer), sizeof(sinceTimer));
+    char keyboard[2] = {keyboardBuf.load(), keyBarrier.load()};
+    out.write(keyboard, sizeof(keyboard));
+    uint32_t numSections = sections.size();
+    out.write(reinterpret_cast<const char *>(&numSections), sizeof(numSections));
+    out.write(reinterpret_cast<const char *>(sections.data()), numSections * sizeof(LoadedSection));
+    memory.save(out);
+}
+
+void Program::restoreState(std::istream &in) {
+    uint32_t magic;
+    in.read(reinterpret_cast<char *>(&magic), sizeof(magic));
+    if (!in || magic != SNAPSHOT_MAGIC)
+        throw std::runtime_error("Not a snapshot file");
+    in.read(reinterpret_cast<char *>(gpr_registers.data()), gpr_registers.size() * sizeof(int32_t));
+    in.read(reinterpret_cast<char *>(csr_registers.data()), csr_registers.size() * sizeof(int32_t));
+    in.read(reinterpret_cast<char *>(&psw.val), sizeof(psw.val));
+    in.read(reinterpret_cast<char *>(&instrCounter), sizeof(instrCounter));
+    int64_t sinceTimer;
+    in.read(reinterpret_cast<char *>(&sinceTimer), sizeof(sinceTimer));
+    lastTimerExecution = std::chrono::system_clock::now() - std::chrono::nanoseconds(sinceTimer);
+    char keyboard[2];
+    in.read(keyboard, sizeof(keyboard));
+    keyboardBuf = keyboard[0];
+    keyBarrier = keyboard[1];
+    uint32_t numSections;
+    in.read(reinterpret_cast<char *>(&numSections), sizeof(numSections));
+    sections.resize(numSections);
+    in.read(reinterpret_cast<char *>(sections.data()), numSections * sizeof(LoadedSection));
+    memory.restore(in);
+    if (!in)
+        throw std::runtime_error("Truncated snapshot file");
 }
 
 uint32_t Program::signExt(uint32_t val, size_t size) {
@@ -51,12 +246,16 @@ void Program::push(int32_t val) {
         throw std::runtime_error("Stack overflow!");
     *LOG << "Stack push " << std::hex << val << '\n';
     SP() -= STACK_INCREMENT;
+    for (auto *observer: memoryObservers)
+        observer->onWrite(*this, SP());
     memory.writeWord(SP(), val);
 }
 
 int32_t Program::pop() {
     if (SP() >= memory._minAddr + memory._size)
         throw std::runtime_error("Stack underflow!");
+    for (auto *observer: memoryObservers)
+        observer->onRead(*this, SP());
     auto ret = memory.readWord(SP());
     SP() += STACK_INCREMENT;
     *LOG << "Stack pop " << std::hex << ret << '\n';
@@ -68,9 +267,7 @@ void Program::initOld() {
     psw.Tr = 1;
     executionStart = std::chrono::system_clock::now();
     lastTimerExecution = executionStart;
-    int iRet1 = pthread_create(&keyboardThread, nullptr, KeyboardThread, nullptr);
-    if (iRet1)
-        throw std::runtime_error(&"Error - pthread_create() return code: "[iRet1]);
+    startDevices();
     //call first routine
 //    push(LR);
 //    LR = PC();
@@ -79,11 +276,27 @@ void Program::initOld() {
     PC() = memory.readWord(0);
 }
 
+void Program::startDevices() {
+    lastTimerExecution = std::chrono::system_clock::now();
+    int iRet1 = pthread_create(&keyboardThread, nullptr, KeyboardThread, this);
+    if (iRet1)
+        throw std::runtime_error("Error - pthread_create() return code: " + std::to_string(iRet1));
+}
+
+void Program::disableTrace() {
+    // writes to a failed stream are no-ops
+    trace = false;
+    LOG->setstate(std::ios::badbit);
+}
+
 void Program::loadInstr() {
+    for (auto *observer: memoryObservers)
+        observer->onFetch(*this, PC());
     currInstr.value = memory.readWord(PC());
 }
 
 void Program::initNew() {
+    executionStart = std::chrono::system_clock::now();
     loadInstr();
 }
 
@@ -94,12 +307,79 @@ void Program::readNext() {
     loadInstr();
 }
 
+void Program::step() {
+    try {
+        executeCurrent();
+    } catch (...) {
+        // counted on entry, the faulting instruction did not retire
+        --instrCounter;
+        throw;
+    }
+    if (!isEnd)
+        advance();
+}
+
+void Program::advance() {
+    readNext();
+    setReg0();
+    if (devices)
+        handleInterrupts();
+    if (multiCore)
+        handleIpi();
+    if (semihost)
+        handleSemihost();
+}
+
+void Program::insertBreakpoints() {
+    // a hit costs a BREAKPOINT dispatch, nothing is checked when execution does not reach one
+    for (auto addr: breakpoints) {
+        auto word = (uint32_t) memory.readWord(addr);
+        if (word == BREAKPOINT)
+            continue;
+        originalWords[addr] = word;
+        memory.patchWord(addr, BREAKPOINT);
+    }
+}
+
+void Program::removeBreakpoints() {
+    // also scrubs breakpoints that came back with restored memory
+    for (auto &original: originalWords)
+        if ((uint32_t) memory.readWord(original.first) == BREAKPOINT)
+            memory.patchWord(original.first, original.second);
+    if (currInstr.value == BREAKPOINT && originalWords.count(PC()))
+        currInstr.value = originalWords[PC()];
+}
+
 void Program::setMemory(uint32_t addr, int32_t val) {
     *LOG << "Set memory: [0x" << std::hex << addr << "] = " << val << "\n";
+    for (auto *observer: memoryObservers)
+        observer->onWrite(*this, addr);
     memory.writeWord(addr, val);
 }
 
+int32_t Program::exchangeMemory(uint32_t addr, int32_t val) {
+    for (auto *observer: memoryObservers) {
+        observer->onRead(*this, addr);
+        observer->onWrite(*this, addr);
+    }
+    auto res = memory.exchange(addr, val);
+    *LOG << "Swapped memory: [0x" << std::hex << addr << "] = " << val << " - " << res << '\n';
+    return res;
+}
+
+int32_t Program::compareExchangeMemory(uint32_t addr, int32_t expected, int32_t val) {
+    for (auto *observer: memoryObservers) {
+        observer->onRead(*this, addr);
+        observer->onWrite(*this, addr);
+    }
+    auto res = memory.compareExchange(addr, expected, val);
+    *LOG << "Compare and swap: [0x" << std::hex << addr << "] " << expected << " -> " << val << " - " << res << '\n';
+    return res;
+}
+
 int32_t Program::getMemory(uint32_t addr) {
+    for (auto *observer: memoryObservers)
+        observer->onRead(*this, addr);
     uint32_t res = memory.readWord(addr);
     *LOG << "Fetched memory from " << std::hex << addr << " - " << res << '\n';
     return res;
@@ -120,9 +400,9 @@ void Program::logState() {
          //         << "LR =0x" << std::setfill('0') << std::setw(8) << std::hex << LR << " "
          << "SP =0x" << std::setfill('0') << std::setw(8) << std::hex << SP() << " "
          << "psw=0x" << std::setfill('0') << std::setw(8) << std::hex << psw.val << '\n';
-    *LOG << "STATUS =0x" << std::setfill('0') << std::setw(8) << std::hex << csr_registers[16] << " "
-         << "HANDLER =0x" << std::setfill('0') << std::setw(8) << std::hex << csr_registers[17] << " "
-         << "CAUSE =0x" << std::setfill('0') << std::setw(8) << std::hex << csr_registers[18] << '\n';
+    *LOG << "STATUS =0x" << std::setfill('0') << std::setw(8) << std::hex << STATUS() << " "
+         << "HANDLER =0x" << std::setfill('0') << std::setw(8) << std::hex << HANDLER() << " "
+         << "CAUSE =0x" << std::setfill('0') << std::setw(8) << std::hex << CAUSE() << '\n';
 //    uint32_t Tr: 1, Tl: 1, I: 1, : 24, Z: 1, O: 1, C: 1, N: 1;
 
     *LOG << "TR=" << psw.Tr << " TL=" << psw.Tl << " I=" << psw.I <<
@@ -130,8 +410,55 @@ void Program::logState() {
          '\n';
 }
 
+void Program::notifyCall(uint32_t returnAddr) {
+    for (auto *observer: observers)
+        observer->onCall(*this, returnAddr);
+}
+
+void Program::notifyReturn() {
+    for (auto *observer: observers)
+        observer->onReturn(*this);
+}
+
+void Program::notifyRange(uint32_t addr, uint32_t length, bool write) {
+    for (auto *observer: memoryObservers)
+        for (uint64_t offset = 0; offset < length; offset += sizeof(uint32_t))
+            if (write)
+                observer->onWrite(*this, addr + offset);
+            else
+                observer->onRead(*this, addr + offset);
+}
+
+void Program::notifyInterrupt(uint32_t cause, uint32_t returnAddr) {
+    for (auto *observer: observers)
+        observer->onInterrupt(*this, cause, returnAddr);
+}
+
+void Program::addObserver(Observer *observer) {
+    observers.push_back(observer);
+    if (observer->watchesMemory())
+        memoryObservers.push_back(observer);
+}
+
+void Program::notifyExit() {
+    for (auto *observer: observers)
+        observer->onExit(*this);
+}
+
+void Program::jump(int32_t target) {
+    // not taken branches fall through to the next instruction
+    PC() = target;
+    incrementPC = false;
+    for (auto *observer: observers)
+        observer->onBranch(*this);
+}
+
 void Program::executeCurrent() {
-    logState();
+    if (trace)
+        logState();
+    ++instrCounter;
+    for (auto *observer: observers)
+        observer->onExecute(*this);
     int32_t temp;
     auto code = (INSTRUCTION) currInstr.byte_0;
     switch (code) {
@@ -139,67 +466,74 @@ void Program::executeCurrent() {
             isEnd = true;
             break;
         case INT:               // push status; push pc; cause<=4; status<=status&(~0x1); pc<=handler;
+            temp = PC();
             push(STATUS());
             push(PC());
             CAUSE() = STATUS::SOFTWARE;
             STATUS() &= ~0x1;
             PC() = HANDLER();
             incrementPC = false;
+            notifyInterrupt(STATUS::SOFTWARE, temp);
             break;
         case CALL:              // push pc; pc<=gpr[A=PC]+gpr[B=0]+D
+            temp = PC();
             push(PC());
             PC() = gpr_registers[currInstr.REG_A] + gpr_registers[currInstr.REG_B] + displacement();
             incrementPC = false;
+            notifyCall(temp);
             break;
         case CALL_MEM:         // push pc; pc<=memory[gpr[A=PC]+gpr[B=0]+D]
+            temp = PC();
             push(PC());
             PC() = getMemory(
                     gpr_registers[currInstr.REG_A] + gpr_registers[currInstr.REG_B] + displacement());
             incrementPC = false;
+            notifyCall(temp);
             break;
         case JMP:               // pc<=gpr[A=PC]+D
-            PC() = gpr_registers[currInstr.REG_A] + displacement();
-            incrementPC = false;
+            jump(gpr_registers[currInstr.REG_A] + displacement());
             break;
         case BEQ :               // if (gpr[B] == gpr[C]) pc<=gpr[A=PC]+D
             if (gpr_registers[currInstr.REG_B] == gpr_registers[currInstr.REG_C])
-                PC() = gpr_registers[currInstr.REG_A] + displacement();
-            incrementPC = false;
+                jump(gpr_registers[currInstr.REG_A] + displacement());
             break;
         case BNE:               // if (gpr[B] != gpr[C]) pc<=gpr[A=PC]+D
             if (gpr_registers[currInstr.REG_B] != gpr_registers[currInstr.REG_C])
-                PC() = gpr_registers[currInstr.REG_A] + displacement();
-            incrementPC = false;
+                jump(gpr_registers[currInstr.REG_A] + displacement());
             break;
         case BGT:             // if (gpr[B] signed> gpr[C]) pc<=gpr[A]+D
             if (gpr_registers[currInstr.REG_B] > gpr_registers[currInstr.REG_C])
-                PC() = gpr_registers[currInstr.REG_A] + displacement();
-            incrementPC = false;
+                jump(gpr_registers[currInstr.REG_A] + displacement());
             break;
         case JMP_MEM:           // pc<=memory[gpr[A]+D]
-            PC() = getMemory(gpr_registers[currInstr.REG_A] + displacement());
-            incrementPC = false;
+            jump(getMemory(gpr_registers[currInstr.REG_A] + displacement()));
             break;
         case BEQ_MEM:           // if (gpr[B] == gpr[C]) pc<=memory[gpr[A=PC]+D]
             if (gpr_registers[currInstr.REG_B] == gpr_registers[currInstr.REG_C])
-                PC() = getMemory(gpr_registers[currInstr.REG_A] + displacement());
-            incrementPC = false;
+                jump(getMemory(gpr_registers[currInstr.REG_A] + displacement()));
             break;
         case BNE_MEM:          // if (gpr[B] != gpr[C]) pc<=memory[gpr[A=PC]+D]
             if (gpr_registers[currInstr.REG_B] != gpr_registers[currInstr.REG_C])
-                PC() = getMemory(gpr_registers[currInstr.REG_A] + displacement());
-            incrementPC = false;
+                jump(getMemory(gpr_registers[currInstr.REG_A] + displacement()));
             break;
         case BGT_MEM:          // if (gpr[B] signed> gpr[C]) pc<=memory[gpr[A=PC]+D]
             if (gpr_registers[currInstr.REG_B] > gpr_registers[currInstr.REG_C])
-                PC() = getMemory(gpr_registers[currInstr.REG_A] + displacement());
-            incrementPC = false;
+                jump(getMemory(gpr_registers[currInstr.REG_A] + displacement()));
             break;
         case XCHG:              // temp<=gpr[B]; gpr[B]<=gpr[C]; gpr[C]<=temp;
             temp = gpr_registers[currInstr.REG_B];
             gpr_registers[currInstr.REG_B] = gpr_registers[currInstr.REG_C];
             gpr_registers[currInstr.REG_C] = temp;
             break;
+        case SWAP:              // atomic: temp<=memory[gpr[A]]; memory[gpr[A]]<=gpr[C]; gpr[C]<=temp;
+            gpr_registers[currInstr.REG_C] = exchangeMemory(gpr_registers[currInstr.REG_A],
+                                                            gpr_registers[currInstr.REG_C]);
+            break;
+        case CAS:               // atomic: temp<=memory[gpr[A]]; if (temp == gpr[B]) memory[gpr[A]]<=gpr[C]; gpr[C]<=temp;
+            gpr_registers[currInstr.REG_C] = compareExchangeMemory(gpr_registers[currInstr.REG_A],
+                                                                   gpr_registers[currInstr.REG_B],
+                                                                   gpr_registers[currInstr.REG_C]);
+            break;
         case ADD:              // gpr[A]<=gpr[B]+gpr[C]
             gpr_registers[currInstr.REG_A] = sum(gpr_registers[currInstr.REG_B],
                                                  gpr_registers[currInstr.REG_C]);
@@ -252,7 +586,7 @@ void Program::executeCurrent() {
             setMemory(gpr_registers[currInstr.REG_A], gpr_registers[currInstr.REG_C]);
             break;
         case LD_CSR:            // gpr[A]<=csr[B] ## CSRRD
-            gpr_registers[currInstr.REG_A] = gpr_registers[currInstr.REG_B];
+            gpr_registers[currInstr.REG_A] = csr_registers[currInstr.REG_B];
             break;
         case LD:                // gpr[A]<=gpr[B]+D
             gpr_registers[currInstr.REG_A] = gpr_registers[currInstr.REG_B] + displacement();
@@ -263,6 +597,8 @@ void Program::executeCurrent() {
         case LD_POST_INC:       // gpr[A]<=memory[gpr[B]]; gpr[B]<=gpr[B]+D ## POP, RET
             gpr_registers[currInstr.REG_A] = getMemory(gpr_registers[currInstr.REG_B]);
             gpr_registers[currInstr.REG_B] = gpr_registers[currInstr.REG_B] + displacement();
+            if (currInstr.REG_A == REG_PC)
+                notifyReturn();
             break;
         case CSR_LD:            // csr[A]<=gpr[B] ## CSRWR
             csr_registers[currInstr.REG_A] = gpr_registers[currInstr.REG_B];
@@ -278,32 +614,178 @@ void Program::executeCurrent() {
             csr_registers[currInstr.REG_A] = getMemory(gpr_registers[currInstr.REG_B]);
             gpr_registers[currInstr.REG_B] = gpr_registers[currInstr.REG_B] + displacement();
             break;
+        case BREAKPOINT:        // not retired, executed again once the debugger removed the breakpoint
+            --instrCounter;
+            breakHit = true;
+            isEnd = true;
+            return;
         default:
             throw std::runtime_error("Unknown instruction " + std::to_string(currInstr.value));
     }
-    logState();
-//    handleInterrupts();
+    if (trace)
+        logState();
     *LOG << '\n';
 }
 
 void Program::handleInterrupts() {
-    auto timeNow = std::chrono::system_clock::now();
-    auto elapsed = timeNow - lastTimerExecution;
-    //TODO: hardcoded
-    if (elapsed.count() >= 1.0) {
-        lastTimerExecution = timeNow;
-        timerInterrupt();
+    // the first interrupt taken sets the global mask, the devices after it stay pending until the handler returns
+    DeviceEvent event{instrCounter, EV_TIMER, 0};
+    if (eventLog && eventLog->replaying) {
+        // only recorded inputs, the keyboard and the wall clock are ignored
+        while (eventLog->next(instrCounter, event))
+            deliver(event);
+    } else {
+        if (timerPeriod.count()) {
+            auto timeNow = std::chrono::system_clock::now();
+            if (timeNow - lastTimerExecution >= timerPeriod) {
+                lastTimerExecution = timeNow;
+                deliver(event);
+            }
+        }
+        if (keyBarrier)
+            deliver({instrCounter, EV_KEY, (uint8_t) keyboardBuf.load()});
     }
-    if (keyBarrier)
-        keyInterr();
     // TODO
     auto state = memory.readWord(OUTPUT_STATUS_POS);
     if (state != 0) {
         memory.writeWord(OUTPUT_STATUS_POS, 0);
-        std::cout << state;
-        std::cout.flush();
+        output(state);
         *LOG << "Print char: " << state << '\n';
     }
+    handleDma();
+    if (disk)
+        handleDisk();
+}
+
+void Program::handleDma() {
+    // the whole transfer happens between two instructions, all device state lives in its registers
+    auto ctrl = memory.readWord(DMA_CTRL_POS);
+    if (ctrl & DMA_START) {
+        auto src = (uint32_t) memory.readWord(DMA_SRC_POS);
+        auto dst = (uint32_t) memory.readWord(DMA_DST_POS);
+        auto len = (uint32_t) memory.readWord(DMA_LEN_POS);
+        // a bad range is the guest's error, it is reported in the register instead of faulting the emulator
+        auto ok = memory.isRangeValid(dst, len) && ((ctrl & DMA_FILL) || memory.isRangeValid(src, len));
+        if (!ok)
+            *LOG << "DMA failed: [0x" << std::hex << dst << "] = [0x" << src << "] x " << len << '\n';
+        else if (ctrl & DMA_FILL) {
+            memory.fillMemory(dst, (uint8_t) src, len);
+            notifyRange(dst, len, true);
+            *LOG << "DMA fill: [0x" << std::hex << dst << "] = " << (src & 0xff) << " x " << len << '\n';
+        } else {
+            memory.copyMemory(dst, src, len);
+            notifyRange(src, len, false);
+            notifyRange(dst, len, true);
+            *LOG << "DMA copy: [0x" << std::hex << dst << "] = [0x" << src << "] x " << len << '\n';
+        }
+        ctrl = (ctrl & ~(DMA_START | DMA_FILL | DMA_ERROR)) | DMA_DONE | (ok ? 0 : DMA_ERROR);
+        memory.writeWord(DMA_CTRL_POS, ctrl);
+    }
+    // a masked completion stays pending in the register
+    if ((ctrl & DMA_DONE) && (ctrl & DMA_IRQ) && !isMasked(STATUS_DMA_MASK)) {
+        memory.writeWord(DMA_CTRL_POS, ctrl & ~DMA_IRQ);
+        *LOG << "DMA interrupt!" << '\n';
+        interrupt(STATUS::DMA);
+    }
+}
+
+void Program::handleIpi() {
+    // every core has a mailbox word, any nonzero value written there by another core raises the interrupt
+    auto mailbox = IPI_POS + sizeof(uint32_t) * COREID();
+    if (!memory.readWord(mailbox) || isMasked(STATUS_IPI_MASK))
+        return;
+    memory.exchange(mailbox, 0);
+    *LOG << "Inter-processor interrupt!" << '\n';
+    interrupt(STATUS::IPI);
+}
+
+void Program::attachDisk(BlockDevice *device) {
+    disk = device;
+    memory.writeWord(DISK_SECTORS_POS, disk->sectors());
+}
+
+void Program::handleDisk() {
+    // same protocol as the DMA device, a command runs to completion between two instructions
+    auto cmd = memory.readWord(DISK_CMD_POS);
+    if (cmd & (DISK_READ | DISK_WRITE)) {
+        auto sector = (uint32_t) memory.readWord(DISK_SECTOR_POS);
+        auto buffer = (uint32_t) memory.readWord(DISK_BUFFER_POS);
+        auto count = (uint32_t) memory.readWord(DISK_COUNT_POS);
+        auto ok = cmd & DISK_READ ? disk->read(memory, sector, buffer, count)
+                                  : disk->write(memory, sector, buffer, count);
+        if (ok)
+            notifyRange(buffer, count * DISK_SECTOR_SIZE, cmd & DISK_READ);
+        *LOG << "Disk " << (cmd & DISK_READ ? "read" : "write") << ": sector " << std::dec << sector << " x " << count
+             << " at 0x" << std::hex << buffer << (ok ? "" : " failed") << '\n';
+        cmd = (cmd & ~(DISK_READ | DISK_WRITE | DISK_ERROR)) | DISK_DONE | (ok ? 0 : DISK_ERROR);
+        memory.writeWord(DISK_CMD_POS, cmd);
+    }
+    if ((cmd & DISK_DONE) && (cmd & DISK_IRQ) && !isMasked(STATUS_DISK_MASK)) {
+        memory.writeWord(DISK_CMD_POS, cmd & ~DISK_IRQ);
+        *LOG << "Disk interrupt!" << '\n';
+        interrupt(STATUS::DISK);
+    }
+}
+
+void Program::handleSemihost() {
+    // not a device interrupt, the call is done before the instruction after the doorbell write
+    auto op = memory.readWord(SEMI_CALL_POS);
+    if (!op)
+        return;
+    auto arg0 = memory.readWord(SEMI_ARG0_POS);
+    if (op == SEMI_EXIT) {
+        *LOG << "Semihost exit: " << std::dec << arg0 << '\n';
+        exitStatus = arg0;
+        isEnd = true;
+    } else {
+        auto replaying = eventLog && eventLog->replaying;
+        DeviceEvent event{instrCounter, EV_SEMIHOST, 0};
+        if (replaying && !eventLog->next(instrCounter, event, true))
+            throw std::runtime_error("Replay diverged, semihost call at instruction " + std::to_string(instrCounter)
+                                     + " was not recorded");
+        // the clocks are inputs like the keyboard, file calls run again and have to return what they did
+        auto result = replaying && (op == SEMI_TIME || op == SEMI_CLOCK)
+                      ? event.value
+                      : semihost->call(memory, op, arg0, memory.readWord(SEMI_ARG1_POS), memory.readWord(SEMI_ARG2_POS));
+        if (replaying && result != event.value)
+            throw std::runtime_error("Replay diverged, semihost call at instruction " + std::to_string(instrCounter)
+                                     + " returned " + std::to_string(result));
+        if (eventLog && !replaying) {
+            event.value = result;
+            eventLog->record(event);
+        }
+        *LOG << "Semihost call " << std::dec << op << ": " << result << '\n';
+        memory.writeWord(SEMI_RESULT_POS, result);
+    }
+    memory.writeWord(SEMI_CALL_POS, 0);
+}
+
+void Program::deliver(const DeviceEvent &event) {
+    auto accepted = event.type == EV_TIMER ? timerInterrupt() : keyInterr((char) event.value);
+    if (!eventLog)
+        return;
+    if (eventLog->replaying && !accepted)
+        throw std::runtime_error("Replay diverged, interrupt at instruction " + std::to_string(event.instr)
+                                 + " is masked");
+    if (!eventLog->replaying && accepted)
+        eventLog->record(event);
+}
+
+bool Program::isMasked(uint32_t mask) {
+    return (STATUS() & STATUS_INTERRUPT_MASK) || (STATUS() & mask);
+}
+
+void Program::interrupt(uint32_t cause) {
+    // called between instructions, PC is the next one and a return adds INSTR_SIZE to the popped address
+    auto returnAddr = PC() - INSTR_SIZE;
+    push(STATUS());
+    push(returnAddr);
+    CAUSE() = cause;
+    // handlers run with every interrupt masked, the iret restores the pushed status
+    STATUS() |= STATUS_INTERRUPT_MASK;
+    PC() = HANDLER();
+    loadInstr();
+    notifyInterrupt(cause, returnAddr);
 }
 
 int32_t &Program::STATUS() {
@@ -326,54 +808,44 @@ int32_t &Program::SP() {
     return gpr_registers[14];
 }
 
-void Program::keyInterr() {
-    if (psw.I) {
+int32_t &Program::COREID() {
+    return csr_registers[REG_CSR::CSR_COREID];
+}
+
+bool Program::keyInterr(char key) {
+    if (isMasked(STATUS_TERMINAL_MASK)) {
         *LOG << "Masked interrupts (keyboard)" << '\n';
-        return;
+        return false;
     }
-    *LOG << "Keyboard interrupt!" << '\n';
-    auto temp = keyboardBuf;
+    *LOG << "Keyboard interrupt! " << key << '\n';
     keyBarrier = false;
-    memory.writeWord(KEYBOARD_POS, temp);
+    memory.writeWord(KEYBOARD_POS, key);
     auto mask = KEYBOARD_STATUS_MASK;
     memory.writeWord(KEYBOARD_STATUS_POS, mask);
-//    push(LR);
-//    LR = PC();
-    push(psw.val);
-    psw.I = 1;
-    // TODO
-//    memcpy(&PC(), memory.data() + 12, 4);
-//    PC() += START_POINT;
+    interrupt(STATUS::TERMINAL);
+    return true;
 }
 
-void Program::timerInterrupt() {
-    if (psw.I) {
-        *LOG << "Masked interrupts (timer)" << '\n';
-        return;
-    }
-    if (!psw.Tr) {
+bool Program::timerInterrupt() {
+    if (isMasked(STATUS_TIMER_MASK)) {
         *LOG << "Masked timer interrupt" << '\n';
-        return;
+        return false;
     }
     *LOG << "Timer interrupt!" << '\n';
-//    push(LR);
-//    LR = PC();
-    push(psw.val);
-    psw.I = 1;
-    // TODO
-//    memcpy(&PC(), memory.data() + 4, 4);
-//    PC() += START_POINT;
+    interrupt(STATUS::TIMER);
+    return true;
 }
 
-void *Program::KeyboardThread(void *) {
+void *Program::KeyboardThread(void *arg) {
+    // no logging here, LOG belongs to the emulation thread
+    auto *program = static_cast<Program *>(arg);
     while (true) {
-        while (keyBarrier);
-        *LOG << "Passed barrier" << '\n';
+        while (program->keyBarrier);
         char temp;
-        std::cin >> std::noskipws >> temp;
-        *LOG << "Read char " << temp << '\n';
-        keyboardBuf = temp;
-        keyBarrier = true;
+        if (!(std::cin >> std::noskipws >> temp))
+            return nullptr;
+        program->keyboardBuf = temp;
+        program->keyBarrier = true;
     }
 }
 
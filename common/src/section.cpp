@@ -7,6 +7,7 @@
 Section::Section(std::string name) : core(std::move(name)) {}
 
 void Section::appendInstr(void *src) {
+    core.markCode(core.locationCnt(), 4);
     core.append(src, 4);
 }
 
@@ -13,12 +13,12 @@ void SectionLink::tableHeader(std::ostream &out) {
 std::ostream &operator<<(std::ostream &out, const SectionLink &sec) {
     return out << std::left
                << std::setw(20) << sec.name
-               << std::setw(15) << sec.data.size()
+               << std::setw(15) << sec.size()
                << "\n";
 }
 
 void SectionLink::serialize(std::ostream &out, uint64_t startAddress, char fillChar) const {
-    out << name << " " << std::dec << data.size() << std::right;
+    out << name << " " << std::dec << size() << std::right;
     serializeClean(out, startAddress, fillChar);
     out << "\n" << ".end" << "\n" << "\n";
 }
@@ -68,20 +68,32 @@ bool SectionLink::checkSize(uint32_t pos, uint32_t length) {
 
 
 void SectionLink::reallocateIfNeeded(uint32_t pos, uint32_t length) {
-    if (checkSize(pos, length))
+    if (length == 0 || checkSize(pos, length))
         return;
+    auto oldSize = size();
     auto newSize = pos + length;
     data.resize(newSize);
+    zeroFill = oldSize > newSize ? oldSize - newSize : 0;
 }
 
 void SectionLink::addToLocCounter(uint32_t offset) {
     reallocateIfNeeded(locationCnt(), offset);
 }
 
+void SectionLink::skip(uint32_t length) {
+    zeroFill += length;
+}
+
 int32_t SectionLink::readWord(uint32_t offset) {
-    if (offset > data.size() - 4)
+    if (offset + 4 > size())
         throw std::runtime_error("Reading outside of section bounds");
-    int32_t word;
+    if (offset >= data.size())
+        return 0;
+    int32_t word = 0;
+    if (offset + 4 > data.size()) {
+        std::memcpy(&word, data.data() + offset, data.size() - offset);
+        return word;
+    }
     std::memcpy(&word, data.data() + offset, 4);
     return word;
 }
@@ -92,7 +104,11 @@ void SectionLink::write(const void *src, uint32_t pos, uint32_t length) {
 }
 
 uint32_t SectionLink::locationCnt() const {
-    return (uint32_t) data.size();
+    return size();
+}
+
+uint32_t SectionLink::size() const {
+    return (uint32_t) data.size() + zeroFill;
 }
 
 void SectionLink::append(const void *src, uint32_t length) {
@@ -104,12 +120,23 @@ void SectionLink::writeWord(void *src, uint32_t offset) {
 }
 
 void SectionLink::fixWord(void *src, uint32_t offset) {
-    if (!checkSize(offset, 4))
+    if (offset + 4 > size())
         throw std::runtime_error("Writing outside of section bounds");
-    std::memcpy(data.data() + offset, src, 4);
+    write(src, offset, 4);
+}
+
+void SectionLink::markCode(uint32_t offset, uint32_t length) {
+    if (!code.empty() && code.back().second == offset)
+        code.back().second += length;
+    else
+        code.emplace_back(offset, offset + length);
 }
 
 SectionLink &SectionLink::operator+=(const SectionLink &other) {
+    auto base = locationCnt();
+    for (auto &range: other.code)
+        markCode(base + range.first, range.second - range.first);
     append(other.data.data(), other.data.size());
+    zeroFill += other.zeroFill;
     return *this;
 }
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <ostream>
+
+static constexpr auto BATCH_SLICE = 4096;       // instructions between two looks at the input
+
+struct BatchConfig {
+    std::string manifest;
+    unsigned threads = 0;           // 0 uses every hardware thread
+    uint64_t limit = 100000000;     // instructions per image before it counts as a hang
+    bool semihosting = false;       // images may use host files, only with -semihost
+};
+
+// One manifest line: image [input [expected]], '-' skips a column and '#' starts a comment.
+// Paths are relative to the manifest.
+struct BatchJob {
+    std::string image;
+    std::string input;              // typed into the terminal, one key whenever the previous one was taken
+    std::string expected;           // compared with everything the guest printed
+};
+
+struct BatchResult {
+    bool passed = false;
+    std::string error;
+    uint64_t instructions = 0;
+    double seconds = 0;
+};
+
+// Runs every image of a manifest on its own Machine, spread over a work-stealing pool of threads.
+class BatchRunner {
+    BatchConfig config;
+    std::vector<BatchJob> jobs;
+    std::vector<BatchResult> results;
+
+    void load();
+
+    void runJob(size_t);
+
+    void report(std::ostream &, unsigned, double) const;
+public:
+    explicit BatchRunner(BatchConfig config) : config(std::move(config)) {}
+
+    // true when every image passed
+    bool run();
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+class Memory;
+
+static constexpr auto DISK_SECTOR_SIZE = 512;
+
+// A host file mapped shared, transfers move sectors between the mapping and guest memory and
+// writes reach the file without a copy of it in between. A file that cannot be written is attached read-only.
+class BlockDevice {
+    uint8_t *bytes = nullptr;
+    size_t size = 0;
+
+    [[nodiscard]] bool inside(uint32_t, uint32_t) const;
+public:
+    std::string file;
+    bool readOnly = false;
+
+    explicit BlockDevice(std::string file);
+
+    ~BlockDevice();
+
+    BlockDevice(BlockDevice const &) = delete;
+
+    void operator=(BlockDevice const &) = delete;
+
+    [[nodiscard]] uint32_t sectors() const;
+
+    // false when a sector is outside the disk, the buffer is outside guest memory or the disk is read-only
+    bool read(Memory &, uint32_t sector, uint32_t buffer, uint32_t count);
+
+    bool write(Memory &, uint32_t sector, uint32_t buffer, uint32_t count);
+};
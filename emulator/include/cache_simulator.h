@@ -0,0 +1,67 @@
+#pragma once
+
+#include "observer.h"
+#include "symbol_map.h"
+
+#include <map>
+#include <vector>
+#include <string>
+#include <ostream>
+#include <unordered_map>
+
+enum ACCESS {
+    A_FETCH, A_LOAD, A_STORE, A_COUNT
+};
+
+struct CacheConfig {
+    uint32_t size = 4 * 1024;
+    uint32_t ways = 2;
+    uint32_t lineSize = 32;
+};
+
+struct CacheCounters {
+    uint64_t accesses[A_COUNT] = {};
+    uint64_t misses[A_COUNT] = {};
+
+    CacheCounters &operator+=(const CacheCounters &);
+
+    [[nodiscard]] uint64_t totalAccesses() const;
+
+    [[nodiscard]] uint64_t totalMisses() const;
+};
+
+// Set-associative LRU cache fed with every fetch, load and store, plus an access heatmap per segment.
+class CacheSimulator : public Observer {
+public:
+    CacheConfig config;
+    const SymbolMap &symbolMap;
+    uint32_t sets;
+    uint64_t tick = 0;
+    std::vector<uint32_t> tags;         // sets * ways, line address + 1, 0 is an empty way
+    std::vector<uint64_t> lastUse;
+    CacheCounters total;
+    std::unordered_map<uint32_t, CacheCounters> byPc;
+    std::unordered_map<uint32_t, CacheCounters> byLine;
+
+    explicit CacheSimulator(CacheConfig, const SymbolMap &);
+
+    static CacheConfig parseConfig(const std::string &);
+
+    bool lookup(uint32_t);
+
+    void access(Program &, uint32_t, ACCESS);
+
+    [[nodiscard]] bool watchesMemory() const override { return true; }
+
+    void onFetch(Program &, uint32_t) override;
+
+    void onRead(Program &, uint32_t) override;
+
+    void onWrite(Program &, uint32_t) override;
+
+    void onExit(Program &) override;
+
+    void log(std::ostream &) const;
+
+    static void logTable(std::ostream &, const std::string &, const std::map<std::string, CacheCounters> &);
+};
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "observer.h"
+#include "symbol_map.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <unordered_map>
+
+static constexpr auto CALL_STACK_MAX_DEPTH = 1024;
+
+struct CallNode {
+    uint32_t routine;
+    bool interrupt;
+    uint64_t instructions = 0;
+    CallNode *parent;
+    std::unordered_map<uint64_t, std::unique_ptr<CallNode>> children;
+
+    CallNode(uint32_t routine, bool interrupt, CallNode *parent)
+            : routine(routine), interrupt(interrupt), parent(parent) {}
+
+    CallNode *child(uint32_t, bool);
+};
+
+struct CallFrame {
+    CallNode *node;
+    uint32_t returnAddr;
+    uint32_t sp;            // %sp before the return address (and status) were pushed
+    uint32_t cause;         // innermost interrupt cause, 0 outside of handlers
+    size_t interruptFrame;  // index of the innermost interrupt frame
+};
+
+// Shadow call stack, pushed on call/interrupt and popped on ret/iret.
+class CallStack : public Observer {
+public:
+    std::vector<CallFrame> frames;
+    CallNode root{0, false, nullptr};
+    uint64_t unmatchedReturns = 0;
+    uint64_t droppedFrames = 0;
+
+    [[nodiscard]] CallNode *current();
+
+    void onExecute(Program &) override;
+
+    void onCall(Program &, uint32_t) override;
+
+    void onReturn(Program &) override;
+
+    void onInterrupt(Program &, uint32_t, uint32_t) override;
+
+private:
+    void push(Program &, uint32_t, uint32_t, uint32_t);
+};
+
+// Inclusive instruction counts per call stack, written in folded-stack format (one "a;b;c count" per line).
+class CallProfiler : public CallStack {
+public:
+    std::string outputFile;
+    const SymbolMap &symbolMap;
+
+    explicit CallProfiler(std::string outputFile, const SymbolMap &symbolMap)
+            : outputFile(std::move(outputFile)), symbolMap(symbolMap) {}
+
+    void onExecute(Program &) override;
+
+    void onExit(Program &) override;
+
+    void onFork(Program &, const std::string &) override;
+
+    void writeFolded(std::ostream &, const CallNode &, const std::string &) const;
+
+    [[nodiscard]] std::string frameName(const CallNode &) const;
+};
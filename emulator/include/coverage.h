@@ -0,0 +1,44 @@
+#pragma once
+
+#include "observer.h"
+#include "symbol_map.h"
+
+#include <string>
+#include <vector>
+#include <ostream>
+
+struct CoverageRegion {
+    uint32_t addr;
+    uint32_t slots;             // 4-byte instruction slots
+    std::vector<uint8_t> bits;
+
+    [[nodiscard]] bool covered(uint32_t slot) const;
+};
+
+// One bit per executed instruction slot of the code ranges in the map, of the loaded sections without one.
+// Written at exit, bits already in the output file are kept so runs accumulate.
+class Coverage : public Observer {
+public:
+    std::string outputFile;
+    std::string reportFile;
+    const SymbolMap &symbolMap;
+    std::vector<CoverageRegion> regions;
+    CoverageRegion *last = nullptr;
+
+    explicit Coverage(std::string outputFile, std::string reportFile, const SymbolMap &symbolMap)
+            : outputFile(std::move(outputFile)), reportFile(std::move(reportFile)), symbolMap(symbolMap) {}
+
+    void onExecute(Program &) override;
+
+    void onExit(Program &) override;
+
+    void onFork(Program &, const std::string &) override;
+
+    void init(Program &);
+
+    void merge(const std::string &);
+
+    void write(const std::string &) const;
+
+    void report(std::ostream &) const;
+};
@@ -1,7 +1,17 @@
 #pragma once
 
+#include "observer.h"
+#include "event_log.h"
+#include "fuzzer.h"
+#include "batch_runner.h"
+#include "symbol_map.h"
+#include "block_device.h"
+#include "semihost.h"
+
 #include <fstream>
 #include <memory>
+#include <vector>
+#include <string>
 
 static constexpr auto KB = 1024;
 static constexpr auto MB = 1024 * KB;
@@ -18,22 +28,133 @@ static constexpr auto KEYBOARD_POS = 0x1000;
 static constexpr auto KEYBOARD_STATUS_POS = 0x1010;
 static constexpr auto KEYBOARD_STATUS_MASK = 1L << 9;
 static constexpr auto OUTPUT_STATUS_POS = 0x2010;
+static constexpr auto STATUS_TIMER_MASK = 0x1;
+static constexpr auto STATUS_TERMINAL_MASK = 0x2;
+static constexpr auto STATUS_INTERRUPT_MASK = 0x4;
+static constexpr auto STATUS_IPI_MASK = 0x8;
+static constexpr auto IPI_POS = 0x3000;             // mailbox of core N at IPI_POS + 4 * N
+static constexpr auto STATUS_DMA_MASK = 0x10;
+static constexpr auto DMA_SRC_POS = 0x4000;         // source address, or the fill byte
+static constexpr auto DMA_DST_POS = 0x4004;
+static constexpr auto DMA_LEN_POS = 0x4008;         // in bytes
+static constexpr auto DMA_CTRL_POS = 0x400c;
+static constexpr auto DMA_START = 0x1;              // set by the guest, cleared when the transfer is done
+static constexpr auto DMA_FILL = 0x2;               // memset with the low byte of source instead of memcpy
+static constexpr auto DMA_IRQ = 0x4;                // interrupt when done, cleared when it is taken
+static constexpr auto DMA_DONE = 0x8;
+static constexpr auto DMA_ERROR = 0x10;             // source or destination outside memory, nothing was moved
+static constexpr auto STATUS_DISK_MASK = 0x20;
+static constexpr auto DISK_SECTOR_POS = 0x5000;
+static constexpr auto DISK_BUFFER_POS = 0x5004;     // guest address of the first byte transferred
+static constexpr auto DISK_COUNT_POS = 0x5008;      // in sectors
+static constexpr auto DISK_CMD_POS = 0x500c;
+static constexpr auto DISK_SECTORS_POS = 0x5010;    // size of the attached disk, set when it is attached
+static constexpr auto DISK_READ = 0x1;              // disk to guest memory, cleared when done
+static constexpr auto DISK_WRITE = 0x2;             // guest memory to disk, cleared when done
+static constexpr auto DISK_IRQ = 0x4;               // interrupt when done, cleared when it is taken
+static constexpr auto DISK_DONE = 0x8;
+static constexpr auto DISK_ERROR = 0x10;            // sectors outside the disk, buffer outside memory or a read-only disk
+static constexpr auto SEMI_CALL_POS = 0x6000;       // doorbell, a SEMIHOST_OP
+static constexpr auto SEMI_ARG0_POS = 0x6004;
+static constexpr auto SEMI_ARG1_POS = 0x6008;
+static constexpr auto SEMI_ARG2_POS = 0x600c;
+static constexpr auto SEMI_RESULT_POS = 0x6010;
+static constexpr auto SNAPSHOT_MAGIC = 0x50414e53; // "SNAP"
+static constexpr auto DEFAULT_CHECKPOINT_INTERVAL = 100000;
+static constexpr auto DEFAULT_CHECKPOINT_BUDGET = 64;   // MB
 
 class Program;
 
+class TimeTravel;
+
+typedef struct {
+    std::string symbolsFile;
+    std::string profileFile;
+    bool stackUsage = false;
+    uint32_t stackGuard = 0;
+    std::string cacheConfig;
+    std::string coverageFile;
+    std::string coverageReport;
+    bool stats = false;
+    std::string statsJson;
+    std::string snapshotFile;
+    uint32_t snapshotAtPc = 0;
+    uint64_t snapshotAfter = 0;
+    std::string resumeFile;
+    uint32_t forkAtPc = 0;
+    std::string forkInputs;
+    bool devices = false;
+    bool trace = true;
+    std::string recordFile;
+    std::string replayFile;
+    uint64_t checkpointInterval = 0;
+    size_t checkpointBudget = DEFAULT_CHECKPOINT_BUDGET;
+    bool lastWrite = false;
+    uint32_t lastWriteAddr = 0;
+    std::string gdbAddress;
+    std::string engine;
+    bool lockstep = false;
+    bool fuzzing = false;
+    unsigned cores = 1;
+    std::string diskFile;
+    bool semihosting = false;
+    bool hugePages = false;
+    std::string dumpFile;
+    std::string dumpDiff;           // two dumps separated by a comma
+    std::string dumpCheck;
+    std::string expectFile;
+    FuzzConfig fuzz;
+    BatchConfig batch;
+} EmulatorOptions;
+
 class Emulator {
-    static std::unique_ptr<Emulator> instance;
     std::unique_ptr<Program> program;
     std::string inputFile;
+    SymbolMap symbolMap;
+    std::vector<std::unique_ptr<Observer>> observers;
+    std::unique_ptr<EventLog> eventLog;
+    std::unique_ptr<BlockDevice> disk;
+    std::unique_ptr<Semihost> semihost;
+    TimeTravel *timeTravel = nullptr;
+
+    void postMortem();
+
+    void writeDump();
+
+    // -dump-diff and -dump-check, failure when anything differs
+    int compareDumps();
 public:
+    EmulatorOptions options;
 
-    void operator=(Emulator const &) = delete;
+    Emulator();
+
+    ~Emulator();
 
-    static Emulator &singleton();
+    Emulator(Emulator const &) = delete;
+
+    void operator=(Emulator const &) = delete;
 
     void parseArgs(int, char **);
 
-    void execute();
+    void attachObservers();
 
+    // the process exit status, what the guest passed to SEMI_EXIT or zero
+    int execute();
 
+    // emulator [-symbols=program.map] [-profile=out.folded] [-stack-usage] [-stack-guard=0xFFFF0000]
+    //          [-cache=size,ways,line] [-coverage=cov.bin] [-coverage-report=cov.txt]
+    //          [-stats] [-stats-json=stats.json]
+    //          [-snapshot=state.snap -snapshot-at=0x40000010 | -snapshot-after=1000]
+    //          [-fork-at=0x40000010 -fork-inputs=in1.txt,in2.txt]
+    //          [-devices] [-record=events.bin | -replay=events.bin] [-no-trace]
+    //          [-checkpoint-every=100000] [-checkpoint-budget=64] [-last-write=0x40001000]
+    //          [-gdb=1234 | -gdb=unix:/tmp/emu.sock] [-engine=reference|decoded] [-lockstep]
+    //          [-fuzz-entry=0x40000100 (-fuzz-buffer=0x40002000 | -fuzz-terminal) [-fuzz-runs=100000]
+    //           [-fuzz-timeout=1000000] [-fuzz-max-len=256] [-fuzz-seed=1] [-fuzz-corpus=dir] [-fuzz-crashes=dir]]
+    //          [-cores=4] [-disk=data.img] [-semihost] [-huge-pages] [-dump=run.dump]
+    //          (program | -resume=state.snap)
+    // emulator -batch=manifest.txt [-batch-threads=8] [-batch-limit=100000000] [-semihost]
+    // emulator -dump-diff=a.dump,b.dump
+    // emulator -dump-check=run.dump -expect=expected.txt [-symbols=program.map]
+    //          (only segments written during the run can be checked, image-only data reads as not written)
 };
\ No newline at end of file
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <memory>
+#include <string>
+
+class Program;
+
+class Segment;
+
+static constexpr auto DECODED_BLOCK_MAX = 64;
+
+// Executes guest code one block at a time, a block ends with the first instruction that can change control flow.
+class Engine {
+public:
+    virtual ~Engine() = default;
+
+    virtual void runBlock(Program &) = 0;
+
+    [[nodiscard]] virtual const char *name() const = 0;
+
+    static bool endsBlock(uint32_t);
+
+    static std::unique_ptr<Engine> create(const std::string &);
+};
+
+// Program::executeCurrent, one instruction at a time.
+class ReferenceEngine : public Engine {
+public:
+    void runBlock(Program &) override;
+
+    [[nodiscard]] const char *name() const override { return "reference"; }
+};
+
+enum DECODED_ACCESS : uint8_t {
+    ACCESS_CHECKED,     // address known only when executed, through Program::getMemory and setMemory
+    ACCESS_LITERAL,     // aligned pc relative load, the segment is looked up when the block is decoded
+    ACCESS_STACK        // %sp relative, unchecked while %sp stays aligned
+};
+
+struct DecodedInstr {
+    uint32_t raw;
+    uint8_t opcode;
+    uint8_t a;
+    uint8_t b;
+    uint8_t c;
+    int32_t disp;
+    uint8_t access = ACCESS_CHECKED;
+    uint32_t offset = 0;                // of the literal in its segment
+    Segment *segment = nullptr;         // holding the literal
+};
+
+// Candidate engine, instructions are decoded once per block and kept until their segment is written.
+// Without a trace or memory observers, literal and stack accesses skip the segment lookup and the range and
+// straddle checks: literals were proven aligned when decoded, the stack only has to be aligned when it is used
+// and inside the segment it used last, anything else looks the segment up again.
+class DecodedEngine : public Engine {
+public:
+    std::unordered_map<uint32_t, std::vector<DecodedInstr>> blocks;
+    std::unordered_set<uint32_t> decodedWords;
+    bool flushPending = false;
+    bool unchecked = false;             // set on block entry
+    uint64_t generation = 0;            // of the memory the blocks point into
+    uint32_t stackIndex = 0;
+    uint32_t stackBase = 0;             // guest address of the first byte of stackSegment
+    Segment *stackSegment = nullptr;    // last segment %sp pointed into
+
+    void runBlock(Program &) override;
+
+    [[nodiscard]] const char *name() const override { return "decoded"; }
+
+private:
+    std::vector<DecodedInstr> &decode(Program &, uint32_t);
+
+    void execute(Program &, const DecodedInstr &);
+
+    static void classify(Program &, uint32_t, DecodedInstr &);
+
+    int32_t load(Program &, const DecodedInstr &, uint32_t);
+
+    void store(Program &, const DecodedInstr &, uint32_t, int32_t);
+
+    Segment &stack(Program &, uint32_t);
+
+    int32_t readStack(Program &, uint32_t);
+
+    void writeStack(Program &, uint32_t, int32_t);
+
+    void push(Program &, int32_t);
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+
+enum EVENT {
+    EV_TIMER, EV_KEY,
+    EV_SEMIHOST             // result of a semihost call, not an interrupt
+};
+
+struct DeviceEvent {
+    uint64_t instr;         // retired instructions when the interrupt was accepted
+    uint8_t type;
+    int32_t value;          // key or semihost result
+};
+
+// Non-deterministic device inputs and semihost results, written while recording and re-injected at the same
+// instruction on replay.
+// A recording log without a file only keeps the events in memory, for re-execution after a time travel.
+class EventLog {
+public:
+    bool replaying;
+    bool recording;
+    std::string file;
+    std::ofstream out;
+    std::vector<DeviceEvent> events;
+    size_t nextEvent = 0;
+
+    explicit EventLog(std::string file, bool replaying);
+
+    void record(const DeviceEvent &);
+
+    // a fork child records to its own file, which starts with the events before the fork
+    void moveTo(std::string);
+
+    // device events and semihost results at one instruction are taken by different callers
+    bool next(uint64_t, DeviceEvent &, bool semihost = false);
+
+    void seek(uint64_t);
+
+private:
+    void write(const DeviceEvent &);
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "observer.h"
+
+#include <string>
+#include <vector>
+
+// Runs to a PC, then forks one child per input file. Children share guest memory copy-on-write,
+// each reads its input as terminal input and writes <input>.out, <input>.err (reports) and <input>.log.
+// Other outputs, coverage, profile, statistics, the dump and the -record log, go to <input>.<output file name>.
+class ForkPoint : public Observer {
+public:
+    uint32_t forkPc;
+    std::vector<std::string> inputs;
+    std::vector<std::string *> outputs;     // written by the emulator rather than an observer
+    bool forked = false;
+
+    explicit ForkPoint(uint32_t forkPc, std::vector<std::string> inputs, std::vector<std::string *> outputs)
+            : forkPc(forkPc), inputs(std::move(inputs)), outputs(std::move(outputs)) {}
+
+    static std::vector<std::string> parseInputs(const std::string &);
+
+    // an empty file stays empty, that output is off
+    static std::string childFile(const std::string &input, const std::string &file);
+
+    void onExecute(Program &) override;
+
+    static void redirect(Program &, const std::string &);
+
+    [[noreturn]] void waitChildren(const std::vector<int> &) const;
+};
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "observer.h"
+
+#include <string>
+#include <vector>
+#include <random>
+#include <set>
+#include <unordered_map>
+
+static constexpr auto FUZZ_MAP_SIZE = 1 << 16;
+static constexpr auto FUZZ_KEY_INTERVAL = 256;      // instructions between two injected key presses
+static constexpr auto FUZZ_REPORT_INTERVAL = 1;     // seconds between progress lines
+
+struct FuzzConfig {
+    uint32_t entry = 0;
+    uint32_t buffer = 0;            // input length as a word, then the bytes
+    bool terminal = false;          // input is typed into the terminal instead
+    uint32_t maxLength = 256;
+    uint64_t runs = 0;              // 0 runs until interrupted
+    uint64_t timeout = 1000000;     // instructions per run before it counts as a hang
+    uint32_t seed = 1;
+    std::string corpusDir;
+    std::string crashDir = ".";
+};
+
+// Edge coverage of one run, AFL style hashing of (previous pc, pc) into a fixed map.
+class FuzzCoverage : public Observer {
+public:
+    std::vector<uint8_t> hits = std::vector<uint8_t>(FUZZ_MAP_SIZE, 0);
+    std::vector<uint32_t> touched;
+    uint32_t previous = 0;
+
+    void onExecute(Program &) override;
+
+    void reset();
+};
+
+// Snapshot-reset fuzzing: the machine is captured once at the entry point, each run injects a mutated input,
+// executes to HALT, a fault or the timeout, and only the segments written by the run are restored.
+class Fuzzer {
+public:
+    Program &program;
+    FuzzConfig config;
+    FuzzCoverage coverage;
+    std::vector<int32_t> gpr;
+    std::vector<int32_t> csr;
+    uint32_t psw = 0;
+    char keyboardBuf = 0;
+    bool keyBarrier = false;
+    uint64_t entryInstructions = 0;
+    std::unordered_map<uint32_t, std::vector<uint8_t>> snapshot;
+    std::vector<bool> seen = std::vector<bool>(FUZZ_MAP_SIZE, false);
+    std::vector<std::vector<uint8_t>> corpus;
+    std::set<std::string> crashKinds;       // error and pc, only the first input of a kind is saved
+    std::set<uint32_t> hangPcs;             // pc at the timeout, same for hangs
+    std::mt19937 random;
+    uint64_t runs = 0;
+    uint64_t crashes = 0;
+    uint64_t hangs = 0;
+    uint64_t edges = 0;
+    uint64_t resetSegments = 0;
+
+    explicit Fuzzer(Program &, FuzzConfig);
+
+    void run();
+
+private:
+    void capture();
+
+    void reset();
+
+    std::string execute(const std::vector<uint8_t> &);
+
+    bool newCoverage();
+
+    std::vector<uint8_t> mutate(const std::vector<uint8_t> &);
+
+    void save(const std::string &, const std::vector<uint8_t> &);
+
+    void loadCorpus();
+
+    void report(std::ostream &, double) const;
+};
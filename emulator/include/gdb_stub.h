@@ -0,0 +1,69 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+class Program;
+
+class TimeTravel;
+
+static constexpr auto GDB_NUM_REGS = 19;            // r0-r15, status, handler, cause
+static constexpr auto GDB_POLL_INTERVAL = 1 << 16;  // instructions between checks for a ^C from the debugger
+static constexpr auto GDB_PACKET_SIZE = 0x4000;
+
+// GDB remote serial protocol server over TCP ("1234") or a Unix socket ("unix:/tmp/emu.sock").
+// The stub owns the execution loop while a debugger is attached, normal runs do not pay for it.
+class GdbStub {
+public:
+    Program &program;
+    TimeTravel *timeTravel;
+    int listenFd = -1;
+    int fd = -1;
+    std::string input;
+    bool ack = true;
+    std::vector<std::pair<uint32_t, uint32_t>> watchpoints;     // addr, len
+    bool watchTriggered = false;
+    uint32_t watchAddr = 0;
+
+    explicit GdbStub(Program &, TimeTravel *, const std::string &);
+
+    ~GdbStub();
+
+    void serve();
+
+private:
+    int readByte();
+
+    bool receive(std::string &);
+
+    void send(const std::string &);
+
+    std::string handle(const std::string &, bool &);
+
+    std::string resume(bool);
+
+    std::string reverse(bool);
+
+    bool interrupted();
+
+    void detach();
+
+    void updateWatches();
+
+    uint32_t readRegister(int);
+
+    void writeRegister(int, uint32_t);
+
+    std::string readMemory(uint32_t, uint32_t);
+
+    void writeMemory(uint32_t, const std::string &);
+
+    static std::string targetXml();
+
+    static std::string hexWord(uint32_t);
+
+    static std::string hexValue(uint32_t);
+
+    static uint32_t parseWord(const std::string &);
+};
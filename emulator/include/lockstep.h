@@ -0,0 +1,46 @@
+#pragma once
+
+#include "engine.h"
+#include "observer.h"
+
+#include <memory>
+#include <vector>
+#include <ostream>
+
+class Program;
+
+// Records the addresses written during a block.
+class WriteLog : public Observer {
+public:
+    std::vector<uint32_t> writes;
+
+    [[nodiscard]] bool watchesMemory() const override { return true; }
+
+    void onWrite(Program &, uint32_t addr) override { writes.push_back(addr); }
+};
+
+// Runs the reference interpreter and a candidate engine on separate copies of the machine and compares them
+// after every candidate block: registers, PSW, retired instructions and the memory written. The reference
+// steps until it retired as many instructions as the candidate. The candidate gets no memory observer, which
+// would keep it off its unchecked paths, its writes are found through the segments it dirtied.
+class Lockstep {
+public:
+    Program &reference;
+    std::unique_ptr<Program> copy;
+    std::unique_ptr<Engine> candidate;
+    WriteLog referenceWrites;
+    std::vector<uint32_t> referenceSegments;
+    std::vector<uint32_t> candidateSegments;
+    uint64_t blocks = 0;
+
+    explicit Lockstep(Program &, std::unique_ptr<Engine>);
+
+    void run();
+
+private:
+    void compare(uint32_t);
+
+    void diverged(const std::string &, uint32_t);
+
+    static void dump(std::ostream &, Program &, const std::vector<uint32_t> &);
+};
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <chrono>
+#include <functional>
+
+class Program;
+
+class Observer;
+
+class BlockDevice;
+
+class Semihost;
+
+// One emulated machine for embedding, any number of them can live in a process.
+// Devices are on but nothing reads stdin or writes stdout, input and output go through the calls below,
+// the timer stays off until a period is set. Semihosting stays off until enabled, its stdout goes through onHostOutput.
+class Machine {
+    std::unique_ptr<Program> _program;
+    std::unique_ptr<BlockDevice> _disk;
+    std::unique_ptr<Semihost> _semihost;
+    bool started = false;
+    bool stale = false;
+
+    void start();
+public:
+    // an empty log file keeps no execution log
+    explicit Machine(const std::string &logFile = "");
+
+    ~Machine();
+
+    Machine(Machine const &) = delete;
+
+    void operator=(Machine const &) = delete;
+
+    // image in the linker's -hex output format
+    void loadImage(const std::string &);
+
+    void loadImage(const void *, size_t);
+
+    // runs until halt or maxInstructions more retired instructions, returns how many retired
+    uint64_t run(uint64_t maxInstructions = UINT64_MAX);
+
+    [[nodiscard]] bool halted() const;
+
+    [[nodiscard]] uint64_t instructions() const;
+
+    [[nodiscard]] int32_t reg(uint8_t) const;
+
+    void setReg(uint8_t, int32_t);
+
+    [[nodiscard]] int32_t csr(uint8_t) const;
+
+    void setCsr(uint8_t, int32_t);
+
+    int32_t readWord(uint32_t);
+
+    void writeWord(uint32_t, int32_t);
+
+    // called with every value the guest writes to the terminal
+    void onOutput(std::function<void(int32_t)>);
+
+    // lets the guest open, read and write host files through the semihost calls
+    void enableSemihost();
+
+    // called with every buffer the guest writes to handle 1 through semihosting
+    void onHostOutput(std::function<void(const char *, size_t)>);
+
+    // what the guest passed to SEMI_EXIT, zero when it halted
+    [[nodiscard]] int32_t exitStatus() const;
+
+    // false while the previous key was not taken by the guest
+    bool pressKey(char);
+
+    // zero turns the timer off
+    void setTimerPeriod(std::chrono::nanoseconds);
+
+    void addObserver(Observer *);
+
+    // a host file as the block device at DISK_SECTOR_POS, it stays mapped until the Machine goes away
+    void attachDisk(const std::string &);
+
+    Program &program();
+};
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <ostream>
+
+class Program;
+
+class SymbolMap;
+
+static constexpr auto DUMP_MAGIC = 0x504d5544;     // "DUMP"
+static constexpr auto DUMP_DIFF_LINES = 100;        // differing words printed before the rest is only counted
+
+// Registers and the segments written during a run: magic, segment size, the gpr and csr registers,
+// a sorted index of segment addresses, then the segments in index order.
+class MemoryDump {
+public:
+    uint32_t segmentSize = 0;
+    std::vector<int32_t> gpr;
+    std::vector<int32_t> csr;
+    std::vector<uint32_t> addresses;
+    std::vector<uint8_t> bytes;
+
+    static void write(Program &, const std::string &);
+
+    void load(const std::string &);
+
+    // false when the word lies outside every written segment
+    bool readWord(uint32_t, int32_t &) const;
+
+    // prints what differs, returns how many registers, words and segments do
+    static size_t diff(const MemoryDump &, const MemoryDump &, std::ostream &);
+
+    // one "location value" per line, location is %r0..%r15, %sp, %pc, a symbol or an address with an
+    // optional +offset, '#' starts a comment; prints the mismatches and returns how many there are.
+    // Words in segments the run never wrote are not in the dump and fail as not written, even when
+    // the image initialized them.
+    size_t check(const std::string &, const SymbolMap &, std::ostream &) const;
+};
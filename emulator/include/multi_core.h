@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <ostream>
+
+class Program;
+
+static constexpr auto MAX_CORES = 8;
+static constexpr auto CORE_STACK_SIZE = 256;    // initial SP of core N is DEFAULT_SP - N * CORE_STACK_SIZE
+
+// N cores over one shared Memory, each stepped on its own host thread.
+// Core 0 is the boot Program with its observers and devices, the others start at its PC with their own
+// registers, a stack below the previous core's and %coreid set. Cores signal each other through the
+// mailboxes at IPI_POS and synchronise with swap and cas. Only swap and cas are atomic and ordered, plain
+// loads and stores go to the shared bytes with no ordering between cores.
+class MultiCore {
+    Program &boot;
+    std::vector<std::unique_ptr<Program>> secondaries;
+public:
+    explicit MultiCore(Program &, unsigned, bool);
+
+    ~MultiCore();
+
+    // until every core halted, a fault stops all cores and is rethrown
+    void run();
+
+    void report(std::ostream &) const;
+};
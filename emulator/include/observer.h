@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+class Program;
+
+// Hooks called by Program while executing, analysis tools override what they need.
+class Observer {
+public:
+    virtual ~Observer() = default;
+
+    // before currInstr at PC() is executed
+    virtual void onExecute(Program &) {}
+
+    // after CALL/CALL_MEM, PC() is the target
+    virtual void onCall(Program &, uint32_t returnAddr) {}
+
+    // after a jump or a taken branch, PC() is the target
+    virtual void onBranch(Program &) {}
+
+    // after a pop into PC (ret, iret), PC() is the popped address
+    virtual void onReturn(Program &) {}
+
+    // after an interrupt was accepted, PC() is the handler
+    virtual void onInterrupt(Program &, uint32_t cause, uint32_t returnAddr) {}
+
+    // after the last instruction, or when execution was aborted
+    virtual void onExit(Program &) {}
+
+    // in a child of a fork point, before it runs its input; files written at exit get their own name
+    virtual void onFork(Program &, const std::string &input) {}
+
+    // memory hooks are called only for observers that return true here
+    [[nodiscard]] virtual bool watchesMemory() const { return false; }
+
+    virtual void onFetch(Program &, uint32_t addr) {}
+
+    virtual void onRead(Program &, uint32_t addr) {}
+
+    virtual void onWrite(Program &, uint32_t addr) {}
+};
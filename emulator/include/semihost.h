@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <vector>
+
+class Memory;
+
+// written to SEMI_CALL_POS once the arguments are in place, the register reads zero again when the call is done
+enum SEMIHOST_OP {
+    SEMI_WRITE = 1,     // handle, buffer, length -> bytes written; handle 1 is stdout, 2 stderr
+    SEMI_OPEN,          // path (zero terminated), mode -> handle or -1
+    SEMI_READ,          // handle, buffer, length -> bytes read, 0 at the end of the file
+    SEMI_CLOSE,         // handle -> 0 or -1
+    SEMI_TIME,          // -> host time in seconds since the epoch
+    SEMI_CLOCK,         // -> host microseconds since the emulator started, wraps after 71 minutes
+    SEMI_EXIT           // status, the emulator halts and exits with it
+};
+
+enum SEMIHOST_MODE {
+    SEMI_MODE_READ, SEMI_MODE_WRITE, SEMI_MODE_APPEND
+};
+
+static constexpr auto SEMI_FIRST_HANDLE = 3;
+static constexpr auto SEMI_PATH_MAX = 4096;
+
+// Host services for guests, a whole buffer moves in one call instead of one terminal write per value.
+// Everything but SEMI_EXIT is handled here, exiting is up to the Program.
+class Semihost {
+    std::vector<std::unique_ptr<std::fstream>> files;     // handle N is files[N - SEMI_FIRST_HANDLE]
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    std::fstream *file(int32_t);
+
+    int32_t write(Memory &, int32_t, uint32_t, uint32_t);
+
+    int32_t open(Memory &, uint32_t, int32_t);
+
+    int32_t read(Memory &, int32_t, uint32_t, uint32_t);
+
+    int32_t close(int32_t);
+public:
+    std::function<void(const char *, size_t)> output;     // handle 1, stdout unless replaced
+
+    Semihost();
+
+    int32_t call(Memory &, int32_t op, int32_t arg0, int32_t arg1, int32_t arg2);
+};
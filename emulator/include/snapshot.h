@@ -0,0 +1,23 @@
+#pragma once
+
+#include "observer.h"
+
+#include <string>
+
+// Saves the machine state once execution reaches a PC or a number of retired instructions.
+class SnapshotWriter : public Observer {
+public:
+    std::string outputFile;
+    uint32_t atPc;
+    uint64_t afterInstructions;
+    bool written = false;
+
+    explicit SnapshotWriter(std::string outputFile, uint32_t atPc, uint64_t afterInstructions)
+            : outputFile(std::move(outputFile)), atPc(atPc), afterInstructions(afterInstructions) {}
+
+    void onExecute(Program &) override;
+
+    static void save(Program &, const std::string &);
+
+    static void restore(Program &, const std::string &);
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "call_profiler.h"
+
+#include <map>
+#include <ostream>
+
+struct StackUsage {
+    uint32_t minSp = UINT32_MAX;
+    uint32_t maxDepth = 0;      // bytes below %sp at entry
+
+    void update(uint32_t sp, uint32_t entrySp);
+};
+
+// Lowest %sp reached overall, per interrupt cause and per top-level routine, optional guard address.
+class StackTracker : public CallStack {
+public:
+    const SymbolMap &symbolMap;
+    uint32_t guardAddr;
+    bool guardArmed = false;   // set once %sp left the value it had at the entry point
+    uint32_t lastPc = 0;
+    StackUsage overall;
+    std::map<uint32_t, StackUsage> routines;
+    std::map<uint32_t, StackUsage> causes;
+
+    explicit StackTracker(const SymbolMap &symbolMap, uint32_t guardAddr = 0)
+            : symbolMap(symbolMap), guardAddr(guardAddr) {}
+
+    void onExecute(Program &) override;
+
+    void onExit(Program &) override;
+
+    [[nodiscard]] bool watchesMemory() const override { return guardAddr != 0; }
+
+    // a push writes at the new %sp, checked before the word lands below the guard
+    void onWrite(Program &, uint32_t addr) override;
+
+    void checkGuard(uint32_t);
+
+    void log(std::ostream &) const;
+};
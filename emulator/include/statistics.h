@@ -0,0 +1,59 @@
+#pragma once
+
+#include "observer.h"
+
+#include <map>
+#include <string>
+#include <ostream>
+#include <csignal>
+
+// Retired instructions per opcode, memory traffic, branches and interrupts, wall time and MIPS.
+// Stack traffic is counted as pushes and pops only, taken conditional branches apart from jumps.
+// Printed at exit and whenever the emulator receives SIGUSR1.
+class Statistics : public Observer {
+public:
+    static volatile std::sig_atomic_t dumpRequested;
+
+    std::string jsonFile;
+    uint64_t opcodes[256] = {};
+    uint64_t loads = 0;
+    uint64_t stores = 0;
+    uint64_t fetches = 0;
+    uint64_t pushes = 0;
+    uint64_t pops = 0;
+    uint64_t branches = 0;
+    uint64_t jumps = 0;
+    uint32_t pendingPushes = 0;
+    uint32_t pendingPops = 0;
+    std::map<uint32_t, uint64_t> interrupts;
+
+    explicit Statistics(std::string jsonFile);
+
+    static void onSignal(int);
+
+    [[nodiscard]] bool watchesMemory() const override { return true; }
+
+    void onExecute(Program &) override;
+
+    void onBranch(Program &) override;
+
+    void onInterrupt(Program &, uint32_t, uint32_t) override;
+
+    void onFetch(Program &, uint32_t) override;
+
+    void onRead(Program &, uint32_t) override;
+
+    void onWrite(Program &, uint32_t) override;
+
+    void onExit(Program &) override;
+
+    void onFork(Program &, const std::string &) override;
+
+    [[nodiscard]] static double elapsedSeconds(const Program &);
+
+    [[nodiscard]] static std::string opcodeName(uint32_t);
+
+    void log(std::ostream &, const Program &) const;
+
+    void writeJson(std::ostream &, const Program &) const;
+};
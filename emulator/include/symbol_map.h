@@ -0,0 +1,33 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <cstdint>
+
+struct MapSection {
+    std::string name;
+    uint32_t addr;
+    uint32_t size;
+};
+
+// Symbols and sections of a linked program, read from the .map file written by the linker.
+class SymbolMap {
+public:
+    std::map<uint32_t, std::string> symbols;
+    std::map<uint32_t, MapSection> sections;
+    std::map<uint32_t, uint32_t> code;          // start -> size of the ranges that hold instructions
+
+    void load(const std::string &);
+
+    [[nodiscard]] bool empty() const;
+
+    [[nodiscard]] uint32_t routineAddr(uint32_t) const;
+
+    [[nodiscard]] std::string symbolName(uint32_t) const;
+
+    [[nodiscard]] std::string sectionName(uint32_t) const;
+
+    bool symbolAddr(const std::string &, uint32_t &) const;
+
+    [[nodiscard]] static std::string hexAddr(uint32_t);
+};
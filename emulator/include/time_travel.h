@@ -0,0 +1,53 @@
+#pragma once
+
+#include "observer.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+
+struct Checkpoint {
+    uint64_t retired;
+    std::vector<int32_t> gpr;
+    std::vector<int32_t> csr;
+    uint32_t psw;
+    std::unordered_map<uint32_t, std::vector<uint8_t>> segments;    // written since the previous checkpoint
+};
+
+// Periodic checkpoints of the registers and the dirty segments. Going back restores the nearest earlier
+// checkpoint and re-executes forward, device input is replayed from the event log.
+class TimeTravel : public Observer {
+public:
+    uint64_t interval;
+    size_t budget;              // bytes of segment copies kept on top of the base image
+    size_t used = 0;
+    std::deque<Checkpoint> checkpoints;
+    std::vector<std::pair<uint32_t, uint32_t>> watchRanges;     // addr, len
+    uint32_t lastWriteAddr = 0;
+    uint64_t lastWrite = 0;
+
+    explicit TimeTravel(uint64_t interval, size_t budget) : interval(interval), budget(budget) {}
+
+    void onExecute(Program &) override;
+
+    void onWrite(Program &, uint32_t) override;
+
+    void goTo(Program &, uint64_t);
+
+    bool reverseStep(Program &);
+
+    bool reverseToLastWrite(Program &, const std::vector<std::pair<uint32_t, uint32_t>> &);
+
+private:
+    void checkpoint(Program &, uint64_t);
+
+    void mergeOldest();
+
+    size_t nearest(uint64_t) const;
+
+    void restore(Program &, size_t);
+
+    void run(Program &, uint64_t);
+};
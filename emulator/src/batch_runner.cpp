@@ -0,0 +1,167 @@
+#include "../include/batch_runner.h"
+#include "../include/machine.h"
+#include "../../common/include/log.h"
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <deque>
+
+namespace {
+    std::string readFile(const std::string &path) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in.is_open())
+            throw std::runtime_error("Could not open file " + path);
+        return {std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+    }
+
+    // Every worker pops from the back of its own queue and steals from the front of the others,
+    // images that run long leave their neighbours' work to whoever is idle.
+    class WorkQueues {
+        struct Queue {
+            std::mutex mutex;
+            std::deque<size_t> items;
+        };
+        std::vector<Queue> queues;
+    public:
+        WorkQueues(unsigned workers, size_t items) : queues(workers) {
+            for (size_t i = 0; i < items; ++i)
+                queues[i % workers].items.push_back(i);
+        }
+
+        bool take(unsigned worker, size_t &item) {
+            for (unsigned i = 0; i < queues.size(); ++i) {
+                auto &queue = queues[(worker + i) % queues.size()];
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                if (queue.items.empty())
+                    continue;
+                if (i == 0) {
+                    item = queue.items.back();
+                    queue.items.pop_back();
+                } else {
+                    item = queue.items.front();
+                    queue.items.pop_front();
+                }
+                return true;
+            }
+            return false;
+        }
+    };
+}
+
+void BatchRunner::load() {
+    std::ifstream in(config.manifest);
+    if (!in.is_open())
+        throw std::runtime_error("Could not open file " + config.manifest);
+    auto base = std::filesystem::path(config.manifest).parent_path();
+    auto resolve = [&base](const std::string &column) {
+        return column.empty() || column == "-" ? std::string() : (base / column).string();
+    };
+    std::string line;
+    while (std::getline(in, line)) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream iss(line);
+        std::string image, input, expected;
+        if (!(iss >> image))
+            continue;
+        iss >> input >> expected;
+        jobs.push_back({resolve(image), resolve(input), resolve(expected)});
+    }
+    if (jobs.empty())
+        throw std::runtime_error("No images in " + config.manifest);
+}
+
+void BatchRunner::runJob(size_t index) {
+    auto &job = jobs[index];
+    auto &result = results[index];
+    auto start = std::chrono::steady_clock::now();
+    try {
+        auto input = job.input.empty() ? std::string() : readFile(job.input);
+        Machine machine;
+        if (config.semihosting)
+            machine.enableSemihost();
+        std::ostringstream output;
+        machine.onOutput([&output](int32_t state) { output << state; });
+        machine.onHostOutput([&output](const char *bytes, size_t length) { output.write(bytes, length); });
+        machine.loadImage(job.image);
+        size_t typed = 0;
+        while (!machine.halted() && machine.instructions() < config.limit) {
+            if (typed < input.size() && machine.pressKey(input[typed]))
+                ++typed;
+            machine.run(std::min<uint64_t>(BATCH_SLICE, config.limit - machine.instructions()));
+        }
+        result.instructions = machine.instructions();
+        if (!machine.halted())
+            result.error = "no halt after " + std::to_string(config.limit) + " instructions";
+        else if (machine.exitStatus())
+            result.error = "exit status " + std::to_string(machine.exitStatus());
+        else if (!job.expected.empty() && output.str() != readFile(job.expected))
+            result.error = "output differs";
+        else
+            result.passed = true;
+    } catch (std::exception &error) {
+        result.error = error.what();
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool BatchRunner::run() {
+    load();
+    results.resize(jobs.size());
+    auto threads = config.threads ? config.threads : std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min<unsigned>(threads, jobs.size());
+    WorkQueues queues(threads, jobs.size());
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (unsigned worker = 0; worker < threads; ++worker)
+        workers.emplace_back([this, &queues, worker]() {
+            size_t index;
+            while (queues.take(worker, index))
+                runJob(index);
+        });
+    for (auto &thread: workers)
+        thread.join();
+    auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    report(std::cout, threads, seconds);
+    for (auto &result: results)
+        if (!result.passed)
+            return false;
+    return true;
+}
+
+void BatchRunner::report(std::ostream &out, unsigned threads, double seconds) const {
+    size_t failed = 0;
+    uint64_t instructions = 0;
+    double busy = 0;
+    Log::tableName(out, "Batch");
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        auto &result = results[i];
+        failed += !result.passed;
+        instructions += result.instructions;
+        busy += result.seconds;
+        out << std::left << std::dec << std::setw(6) << (result.passed ? "ok" : "FAIL")
+            << std::setw(14) << result.instructions
+            << std::setw(10) << std::fixed << std::setprecision(3) << result.seconds
+            << jobs[i].image;
+        if (!result.passed)
+            out << ": " << result.error;
+        out << "\n";
+    }
+    Log::tableFooter(out);
+    Log::tableName(out, "Batch summary");
+    out << std::left << std::dec
+        << std::setw(25) << "Images" << jobs.size() << "\n"
+        << std::setw(25) << "Passed" << jobs.size() - failed << "\n"
+        << std::setw(25) << "Failed" << failed << "\n"
+        << std::setw(25) << "Threads" << threads << "\n"
+        << std::setw(25) << "Instructions" << instructions << "\n"
+        << std::setw(25) << "Wall time [s]" << std::fixed << std::setprecision(3) << seconds << "\n"
+        << std::setw(25) << "Busy time [s]" << busy << "\n"
+        << std::setw(25) << "MIPS" << (seconds > 0 ? (double) instructions / seconds / 1e6 : 0.0) << "\n";
+    Log::tableFooter(out);
+}
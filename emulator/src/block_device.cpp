@@ -0,0 +1,63 @@
+#include "../include/block_device.h"
+#include "../../common/include/memory.h"
+
+#include <stdexcept>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+BlockDevice::BlockDevice(std::string file) : file(std::move(file)) {
+    auto fd = open(this->file.c_str(), O_RDWR);
+    if (fd < 0 && (errno == EACCES || errno == EROFS)) {
+        readOnly = true;
+        fd = open(this->file.c_str(), O_RDONLY);
+    }
+    if (fd < 0)
+        throw std::runtime_error("Could not open file " + this->file);
+    struct stat st{};
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        throw std::runtime_error("Could not open file " + this->file);
+    }
+    // a trailing partial sector is not addressable
+    size = (size_t) st.st_size / DISK_SECTOR_SIZE * DISK_SECTOR_SIZE;
+    if (size) {
+        auto *mapped = mmap(nullptr, size, readOnly ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mapped == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("Could not map file " + this->file);
+        }
+        bytes = static_cast<uint8_t *>(mapped);
+    }
+    close(fd);
+}
+
+BlockDevice::~BlockDevice() {
+    if (bytes)
+        munmap(bytes, size);
+}
+
+uint32_t BlockDevice::sectors() const {
+    return size / DISK_SECTOR_SIZE;
+}
+
+bool BlockDevice::inside(uint32_t sector, uint32_t count) const {
+    // the guest address space bounds a transfer too
+    return (uint64_t) sector + count <= sectors() && (uint64_t) count * DISK_SECTOR_SIZE <= UINT32_MAX;
+}
+
+bool BlockDevice::read(Memory &memory, uint32_t sector, uint32_t buffer, uint32_t count) {
+    if (!inside(sector, count) || !memory.isRangeValid(buffer, count * DISK_SECTOR_SIZE))
+        return false;
+    memory.writeBytes(buffer, bytes + (size_t) sector * DISK_SECTOR_SIZE, count * DISK_SECTOR_SIZE);
+    return true;
+}
+
+bool BlockDevice::write(Memory &memory, uint32_t sector, uint32_t buffer, uint32_t count) {
+    if (readOnly || !inside(sector, count) || !memory.isRangeValid(buffer, count * DISK_SECTOR_SIZE))
+        return false;
+    memory.readBytes(buffer, bytes + (size_t) sector * DISK_SECTOR_SIZE, count * DISK_SECTOR_SIZE);
+    return true;
+}
@@ -0,0 +1,141 @@
+#include "../include/cache_simulator.h"
+#include "../include/emulator.h"
+#include "../../common/include/log.h"
+#include "../../common/include/program.h"
+
+#include <iomanip>
+#include <sstream>
+#include <iostream>
+
+CacheCounters &CacheCounters::operator+=(const CacheCounters &other) {
+    for (int i = 0; i < A_COUNT; ++i) {
+        accesses[i] += other.accesses[i];
+        misses[i] += other.misses[i];
+    }
+    return *this;
+}
+
+uint64_t CacheCounters::totalAccesses() const {
+    return accesses[A_FETCH] + accesses[A_LOAD] + accesses[A_STORE];
+}
+
+uint64_t CacheCounters::totalMisses() const {
+    return misses[A_FETCH] + misses[A_LOAD] + misses[A_STORE];
+}
+
+CacheSimulator::CacheSimulator(CacheConfig config, const SymbolMap &symbolMap)
+        : config(config), symbolMap(symbolMap) {
+    if (config.lineSize == 0 || (config.lineSize & (config.lineSize - 1)) != 0 || config.lineSize > SEGMENT_SIZE)
+        throw std::runtime_error("Cache line size must be a power of two up to " + std::to_string(SEGMENT_SIZE));
+    if (config.ways == 0 || config.size % (config.ways * config.lineSize) != 0)
+        throw std::runtime_error("Cache size must be a multiple of ways * line size");
+    sets = config.size / (config.ways * config.lineSize);
+    tags.resize(sets * config.ways, 0);
+    lastUse.resize(sets * config.ways, 0);
+}
+
+CacheConfig CacheSimulator::parseConfig(const std::string &str) {
+    // size,ways,lineSize in bytes
+    CacheConfig config;
+    std::istringstream iss(str);
+    char comma;
+    iss >> config.size >> comma >> config.ways >> comma >> config.lineSize;
+    if (!iss)
+        throw std::runtime_error("Invalid cache configuration " + str + ", expected size,ways,line");
+    return config;
+}
+
+bool CacheSimulator::lookup(uint32_t addr) {
+    uint32_t line = addr / config.lineSize;
+    auto first = (line % sets) * config.ways;
+    auto victim = first;
+    ++tick;
+    for (auto way = first; way < first + config.ways; ++way) {
+        if (tags[way] == line + 1) {
+            lastUse[way] = tick;
+            return true;
+        }
+        if (lastUse[way] < lastUse[victim])
+            victim = way;
+    }
+    tags[victim] = line + 1;
+    lastUse[victim] = tick;
+    return false;
+}
+
+void CacheSimulator::access(Program &program, uint32_t addr, ACCESS type) {
+    auto hit = lookup(addr);
+    auto &pc = byPc[program.PC()];
+    auto &line = byLine[addr & ~(config.lineSize - 1)];
+    ++total.accesses[type];
+    ++pc.accesses[type];
+    ++line.accesses[type];
+    if (hit)
+        return;
+    ++total.misses[type];
+    ++pc.misses[type];
+    ++line.misses[type];
+}
+
+void CacheSimulator::onFetch(Program &program, uint32_t addr) {
+    access(program, addr, A_FETCH);
+}
+
+void CacheSimulator::onRead(Program &program, uint32_t addr) {
+    access(program, addr, A_LOAD);
+}
+
+void CacheSimulator::onWrite(Program &program, uint32_t addr) {
+    access(program, addr, A_STORE);
+}
+
+void CacheSimulator::logTable(std::ostream &out, const std::string &name,
+                              const std::map<std::string, CacheCounters> &rows) {
+    Log::tableName(out, name);
+    out << std::left
+        << std::setw(30) << "Name"
+        << std::setw(12) << "Fetches"
+        << std::setw(12) << "Loads"
+        << std::setw(12) << "Stores"
+        << std::setw(12) << "Misses"
+        << std::setw(12) << "Miss rate"
+        << "\n";
+    for (auto &row: rows) {
+        auto &counters = row.second;
+        auto rate = 100.0 * (double) counters.totalMisses() / (double) counters.totalAccesses();
+        out << std::left << std::dec
+            << std::setw(30) << row.first
+            << std::setw(12) << counters.accesses[A_FETCH]
+            << std::setw(12) << counters.accesses[A_LOAD]
+            << std::setw(12) << counters.accesses[A_STORE]
+            << std::setw(12) << counters.totalMisses()
+            << std::fixed << std::setprecision(2) << rate << "%"
+            << "\n";
+    }
+    Log::tableFooter(out);
+}
+
+void CacheSimulator::log(std::ostream &out) const {
+    std::map<std::string, CacheCounters> totals, routines, sections, segments;
+    std::ostringstream name;
+    name << config.size << "B " << config.ways << "-way " << config.lineSize << "B lines";
+    totals[name.str()] = total;
+
+    // routines by the instruction doing the access, sections and segments by the accessed address
+    for (auto &pc: byPc)
+        routines[symbolMap.symbolName(symbolMap.routineAddr(pc.first))] += pc.second;
+    for (auto &line: byLine) {
+        auto section = symbolMap.sectionName(line.first);
+        sections[section.empty() ? "(none)" : section] += line.second;
+        segments[SymbolMap::hexAddr(line.first - line.first % SEGMENT_SIZE)] += line.second;
+    }
+
+    logTable(out, "Cache", totals);
+    logTable(out, "Cache by routine", routines);
+    logTable(out, "Cache by section", sections);
+    logTable(out, "Access heatmap", segments);
+}
+
+void CacheSimulator::onExit(Program &) {
+    log(std::cerr);
+}
@@ -0,0 +1,96 @@
+#include "../include/call_profiler.h"
+#include "../include/emulator.h"
+#include "../include/fork_point.h"
+#include "../../common/include/program.h"
+
+#include <fstream>
+#include <iostream>
+
+CallNode *CallNode::child(uint32_t childRoutine, bool childInterrupt) {
+    auto key = (static_cast<uint64_t>(childRoutine) << 1) | childInterrupt;
+    auto &node = children[key];
+    if (!node)
+        node = std::make_unique<CallNode>(childRoutine, childInterrupt, this);
+    return node.get();
+}
+
+CallNode *CallStack::current() {
+    return frames.back().node;
+}
+
+void CallStack::onExecute(Program &program) {
+    if (!frames.empty())
+        return;
+    // the first executed instruction is the entry point, root frame is never popped
+    root.routine = program.PC();
+    frames.push_back({&root, UNDEFINED, (uint32_t) program.SP(), 0, 0});
+}
+
+void CallStack::push(Program &program, uint32_t cause, uint32_t returnAddr, uint32_t sp) {
+    if (frames.size() >= CALL_STACK_MAX_DEPTH) {
+        // runaway recursion or handlers that never return, keep attributing to the deepest frame
+        ++droppedFrames;
+        return;
+    }
+    auto &top = frames.back();
+    CallFrame frame{current()->child(program.PC(), cause != 0), returnAddr, sp, top.cause, top.interruptFrame};
+    if (cause) {
+        frame.cause = cause;
+        frame.interruptFrame = frames.size();
+    }
+    frames.push_back(frame);
+}
+
+void CallStack::onCall(Program &program, uint32_t returnAddr) {
+    push(program, 0, returnAddr, program.SP() + STACK_INCREMENT);
+}
+
+void CallStack::onInterrupt(Program &program, uint32_t cause, uint32_t returnAddr) {
+    // pc and status were pushed
+    push(program, cause, returnAddr, program.SP() + 2 * STACK_INCREMENT);
+}
+
+void CallStack::onReturn(Program &program) {
+    // returns may skip frames when %sp was adjusted by hand, unwind to the frame that owns the address
+    uint32_t addr = program.PC();
+    for (auto i = frames.size() - 1; i > 0; --i)
+        if (frames[i].returnAddr == addr) {
+            frames.resize(i);
+            return;
+        }
+    // pop into pc that is not a return (computed jump), stack stays as is
+    ++unmatchedReturns;
+}
+
+void CallProfiler::onExecute(Program &program) {
+    CallStack::onExecute(program);
+    ++current()->instructions;
+}
+
+std::string CallProfiler::frameName(const CallNode &node) const {
+    auto name = symbolMap.symbolName(node.routine);
+    return node.interrupt ? "int:" + name : name;
+}
+
+void CallProfiler::writeFolded(std::ostream &out, const CallNode &node, const std::string &prefix) const {
+    auto stack = prefix.empty() ? frameName(node) : prefix + ";" + frameName(node);
+    if (node.instructions > 0)
+        out << stack << " " << std::dec << node.instructions << "\n";
+    for (auto &child: node.children)
+        writeFolded(out, *child.second, stack);
+}
+
+void CallProfiler::onExit(Program &) {
+    std::ofstream out(outputFile);
+    if (!out)
+        throw std::runtime_error("Failed to open file: " + outputFile);
+    writeFolded(out, root, "");
+    out.close();
+    if (unmatchedReturns || droppedFrames)
+        std::cerr << "Profiler: " << unmatchedReturns << " unmatched returns, "
+                  << droppedFrames << " frames over depth " << CALL_STACK_MAX_DEPTH << '\n';
+}
+
+void CallProfiler::onFork(Program &, const std::string &input) {
+    outputFile = ForkPoint::childFile(input, outputFile);
+}
@@ -0,0 +1,150 @@
+#include "../include/coverage.h"
+#include "../include/emulator.h"
+#include "../include/fork_point.h"
+#include "../../common/include/log.h"
+#include "../../common/include/program.h"
+
+#include <map>
+#include <iomanip>
+#include <fstream>
+#include <iostream>
+
+bool CoverageRegion::covered(uint32_t slot) const {
+    return bits[slot / 8] & (1 << (slot % 8));
+}
+
+void Coverage::init(Program &program) {
+    // literal pools and data directives are not instructions, the map tells them apart when there is one
+    for (auto &range: symbolMap.code) {
+        auto slots = (range.second + INSTR_SIZE - 1) / INSTR_SIZE;
+        regions.push_back({range.first, slots, std::vector<uint8_t>((slots + 7) / 8, 0)});
+    }
+    if (regions.empty())
+        for (auto &section: program.sections) {
+            auto slots = (section.size + INSTR_SIZE - 1) / INSTR_SIZE;
+            regions.push_back({section.addr, slots, std::vector<uint8_t>((slots + 7) / 8, 0)});
+        }
+    last = regions.empty() ? nullptr : &regions.front();
+}
+
+void Coverage::onExecute(Program &program) {
+    if (regions.empty())
+        init(program);
+    uint32_t pc = program.PC();
+    // consecutive instructions almost always stay in the same section
+    if (!last || pc - last->addr >= last->slots * INSTR_SIZE) {
+        last = nullptr;
+        for (auto &region: regions)
+            if (pc - region.addr < region.slots * INSTR_SIZE)
+                last = &region;
+        if (!last)
+            return;
+    }
+    auto slot = (pc - last->addr) / INSTR_SIZE;
+    last->bits[slot / 8] |= 1 << (slot % 8);
+}
+
+void Coverage::merge(const std::string &inputFile) {
+    // same layout as write(), bits of a different image are ignored
+    std::ifstream file(inputFile, std::ios::binary);
+    if (!file.is_open())
+        return;
+    uint32_t numRegions;
+    file.read(reinterpret_cast<char *>(&numRegions), sizeof(numRegions));
+    for (uint32_t i = 0; i < numRegions && file; ++i) {
+        uint32_t addr, slots;
+        file.read(reinterpret_cast<char *>(&addr), sizeof(addr));
+        file.read(reinterpret_cast<char *>(&slots), sizeof(slots));
+        std::vector<uint8_t> bits((slots + 7) / 8);
+        file.read(reinterpret_cast<char *>(bits.data()), (std::streamsize) bits.size());
+        for (auto &region: regions)
+            if (region.addr == addr && region.slots == slots)
+                for (size_t j = 0; j < bits.size(); ++j)
+                    region.bits[j] |= bits[j];
+    }
+    file.close();
+}
+
+void Coverage::write(const std::string &file) const {
+    std::ofstream out(file, std::ios::binary);
+    if (!out)
+        throw std::runtime_error("Failed to open file: " + file);
+    uint32_t numRegions = regions.size();
+    out.write(reinterpret_cast<const char *>(&numRegions), sizeof(numRegions));
+    for (auto &region: regions) {
+        out.write(reinterpret_cast<const char *>(&region.addr), sizeof(region.addr));
+        out.write(reinterpret_cast<const char *>(&region.slots), sizeof(region.slots));
+        out.write(reinterpret_cast<const char *>(region.bits.data()), (std::streamsize) region.bits.size());
+    }
+    out.close();
+}
+
+void Coverage::report(std::ostream &out) const {
+    std::map<std::string, std::pair<uint32_t, uint32_t>> sections, routines;
+    for (auto &region: regions) {
+        auto section = symbolMap.sectionName(region.addr);
+        auto &sectionSlots = sections[section.empty() ? SymbolMap::hexAddr(region.addr) : section];
+        for (uint32_t slot = 0; slot < region.slots; ++slot) {
+            auto addr = region.addr + slot * INSTR_SIZE;
+            auto &routineSlots = routines[symbolMap.symbolName(symbolMap.routineAddr(addr))];
+            auto covered = region.covered(slot);
+            sectionSlots.first += covered;
+            routineSlots.first += covered;
+            ++sectionSlots.second;
+            ++routineSlots.second;
+        }
+    }
+
+    auto table = [&out](const std::string &name, const std::map<std::string, std::pair<uint32_t, uint32_t>> &rows) {
+        Log::tableName(out, name);
+        out << std::left
+            << std::setw(30) << "Name"
+            << std::setw(12) << "Covered"
+            << std::setw(12) << "Slots"
+            << std::setw(12) << "Coverage"
+            << "\n";
+        for (auto &row: rows)
+            out << std::left << std::dec
+                << std::setw(30) << row.first
+                << std::setw(12) << row.second.first
+                << std::setw(12) << row.second.second
+                << std::fixed << std::setprecision(2) << 100.0 * row.second.first / row.second.second << "%"
+                << "\n";
+        Log::tableFooter(out);
+    };
+    table("Coverage by section", sections);
+    table("Coverage by routine", routines);
+
+    Log::tableName(out, "Uncovered");
+    for (auto &region: regions)
+        for (uint32_t slot = 0; slot < region.slots; ++slot) {
+            if (region.covered(slot))
+                continue;
+            auto first = slot;
+            while (slot + 1 < region.slots && !region.covered(slot + 1))
+                ++slot;
+            auto start = region.addr + first * INSTR_SIZE;
+            out << SymbolMap::hexAddr(start) << "-" << SymbolMap::hexAddr(region.addr + slot * INSTR_SIZE + 3)
+                << "  " << symbolMap.symbolName(start) << "\n";
+        }
+    Log::tableFooter(out);
+}
+
+void Coverage::onExit(Program &program) {
+    if (regions.empty())
+        init(program);
+    merge(outputFile);
+    write(outputFile);
+    if (reportFile.empty())
+        return;
+    std::ofstream out(reportFile);
+    if (!out)
+        throw std::runtime_error("Failed to open file: " + reportFile);
+    report(out);
+    out.close();
+}
+
+void Coverage::onFork(Program &, const std::string &input) {
+    outputFile = ForkPoint::childFile(input, outputFile);
+    reportFile = ForkPoint::childFile(input, reportFile);
+}
@@ -1,36 +1,314 @@
 #include "../include/emulator.h"
+#include "../include/call_profiler.h"
+#include "../include/stack_tracker.h"
+#include "../include/cache_simulator.h"
+#include "../include/coverage.h"
+#include "../include/statistics.h"
+#include "../include/snapshot.h"
+#include "../include/fork_point.h"
+#include "../include/time_travel.h"
+#include "../include/gdb_stub.h"
+#include "../include/lockstep.h"
+#include "../include/multi_core.h"
+#include "../include/memory_dump.h"
 #include "../../common/include/program.h"
 
+#include <cstring>
+#include <sstream>
 #include <iostream>
 
-std::unique_ptr<Emulator> Emulator::instance = nullptr;
+Emulator::Emulator() = default;
 
-Emulator &Emulator::singleton() {
-    if (!instance) {
-        instance = std::make_unique<Emulator>();
-        instance->program = std::make_unique<Program>();
-    }
-    return *instance;
-}
+Emulator::~Emulator() = default;
 
 void Emulator::parseArgs(int argc, char **argv) {
-    if (argc < 2) {
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "-symbols=", 9) == 0)
+            options.symbolsFile = argv[i] + 9;
+        else if (strncmp(argv[i], "-profile=", 9) == 0)
+            options.profileFile = argv[i] + 9;
+        else if (strcmp(argv[i], "-stack-usage") == 0)
+            options.stackUsage = true;
+        else if (strncmp(argv[i], "-stack-guard=", 13) == 0) {
+            std::istringstream iss(argv[i] + 13);
+            iss >> std::hex >> options.stackGuard;
+            options.stackUsage = true;
+        } else if (strncmp(argv[i], "-cache=", 7) == 0)
+            options.cacheConfig = argv[i] + 7;
+        else if (strncmp(argv[i], "-coverage=", 10) == 0)
+            options.coverageFile = argv[i] + 10;
+        else if (strncmp(argv[i], "-coverage-report=", 17) == 0)
+            options.coverageReport = argv[i] + 17;
+        else if (strcmp(argv[i], "-stats") == 0)
+            options.stats = true;
+        else if (strncmp(argv[i], "-stats-json=", 12) == 0) {
+            options.statsJson = argv[i] + 12;
+            options.stats = true;
+        } else if (strncmp(argv[i], "-snapshot=", 10) == 0)
+            options.snapshotFile = argv[i] + 10;
+        else if (strncmp(argv[i], "-snapshot-at=", 13) == 0) {
+            std::istringstream iss(argv[i] + 13);
+            iss >> std::hex >> options.snapshotAtPc;
+        } else if (strncmp(argv[i], "-snapshot-after=", 16) == 0)
+            options.snapshotAfter = std::stoull(argv[i] + 16);
+        else if (strncmp(argv[i], "-resume=", 8) == 0)
+            options.resumeFile = argv[i] + 8;
+        else if (strncmp(argv[i], "-fork-at=", 9) == 0) {
+            std::istringstream iss(argv[i] + 9);
+            iss >> std::hex >> options.forkAtPc;
+        } else if (strncmp(argv[i], "-fork-inputs=", 13) == 0)
+            options.forkInputs = argv[i] + 13;
+        else if (strcmp(argv[i], "-devices") == 0)
+            options.devices = true;
+        else if (strcmp(argv[i], "-no-trace") == 0)
+            options.trace = false;
+        else if (strncmp(argv[i], "-record=", 8) == 0) {
+            options.recordFile = argv[i] + 8;
+            options.devices = true;
+        } else if (strncmp(argv[i], "-replay=", 8) == 0) {
+            options.replayFile = argv[i] + 8;
+            options.devices = true;
+        } else if (strncmp(argv[i], "-checkpoint-every=", 18) == 0)
+            options.checkpointInterval = std::stoull(argv[i] + 18);
+        else if (strncmp(argv[i], "-checkpoint-budget=", 19) == 0)
+            options.checkpointBudget = std::stoull(argv[i] + 19);
+        else if (strncmp(argv[i], "-last-write=", 12) == 0) {
+            std::istringstream iss(argv[i] + 12);
+            iss >> std::hex >> options.lastWriteAddr;
+            options.lastWrite = true;
+        } else if (strncmp(argv[i], "-gdb=", 5) == 0)
+            options.gdbAddress = argv[i] + 5;
+        else if (strncmp(argv[i], "-engine=", 8) == 0)
+            options.engine = argv[i] + 8;
+        else if (strcmp(argv[i], "-lockstep") == 0)
+            options.lockstep = true;
+        else if (strncmp(argv[i], "-fuzz-entry=", 12) == 0) {
+            std::istringstream iss(argv[i] + 12);
+            iss >> std::hex >> options.fuzz.entry;
+            options.fuzzing = true;
+        } else if (strncmp(argv[i], "-fuzz-buffer=", 13) == 0) {
+            std::istringstream iss(argv[i] + 13);
+            iss >> std::hex >> options.fuzz.buffer;
+        } else if (strcmp(argv[i], "-fuzz-terminal") == 0)
+            options.fuzz.terminal = true;
+        else if (strncmp(argv[i], "-fuzz-runs=", 11) == 0)
+            options.fuzz.runs = std::stoull(argv[i] + 11);
+        else if (strncmp(argv[i], "-fuzz-timeout=", 14) == 0)
+            options.fuzz.timeout = std::stoull(argv[i] + 14);
+        else if (strncmp(argv[i], "-fuzz-max-len=", 14) == 0)
+            options.fuzz.maxLength = std::stoul(argv[i] + 14);
+        else if (strncmp(argv[i], "-fuzz-seed=", 11) == 0)
+            options.fuzz.seed = std::stoul(argv[i] + 11);
+        else if (strncmp(argv[i], "-fuzz-corpus=", 13) == 0)
+            options.fuzz.corpusDir = argv[i] + 13;
+        else if (strncmp(argv[i], "-fuzz-crashes=", 14) == 0)
+            options.fuzz.crashDir = argv[i] + 14;
+        else if (strncmp(argv[i], "-cores=", 7) == 0)
+            options.cores = std::stoul(argv[i] + 7);
+        else if (strncmp(argv[i], "-disk=", 6) == 0) {
+            options.diskFile = argv[i] + 6;
+            options.devices = true;
+        } else if (strcmp(argv[i], "-semihost") == 0)
+            options.semihosting = true;
+        else if (strcmp(argv[i], "-huge-pages") == 0)
+            options.hugePages = true;
+        else if (strncmp(argv[i], "-batch=", 7) == 0)
+            options.batch.manifest = argv[i] + 7;
+        else if (strncmp(argv[i], "-batch-threads=", 15) == 0)
+            options.batch.threads = std::stoul(argv[i] + 15);
+        else if (strncmp(argv[i], "-batch-limit=", 13) == 0)
+            options.batch.limit = std::stoull(argv[i] + 13);
+        else if (strncmp(argv[i], "-dump=", 6) == 0)
+            options.dumpFile = argv[i] + 6;
+        else if (strncmp(argv[i], "-dump-diff=", 11) == 0)
+            options.dumpDiff = argv[i] + 11;
+        else if (strncmp(argv[i], "-dump-check=", 12) == 0)
+            options.dumpCheck = argv[i] + 12;
+        else if (strncmp(argv[i], "-expect=", 8) == 0)
+            options.expectFile = argv[i] + 8;
+        else
+            inputFile = argv[i];
+    }
+    // every image of a batch gets its own machine
+    if (!options.batch.manifest.empty()) {
+        options.batch.semihosting = options.semihosting;
+        return;
+    }
+    // comparing dumps runs no program
+    if (!options.dumpDiff.empty() || !options.dumpCheck.empty()) {
+        if (!options.symbolsFile.empty())
+            symbolMap.load(options.symbolsFile);
+        return;
+    }
+    if (inputFile.empty() && options.resumeFile.empty()) {
         std::cerr << "No input file" << '\n';
         exit(EXIT_FAILURE);
     }
     program = std::make_unique<Program>();
-    program->load(argv[1]);
+    // before the image is loaded, segments keep the backing they were created with
+    if (options.hugePages)
+        program->memory.useHugePages();
+    if (!options.resumeFile.empty())
+        SnapshotWriter::restore(*program, options.resumeFile);
+    else
+        program->load(inputFile);
+    if (!options.symbolsFile.empty())
+        symbolMap.load(options.symbolsFile);
+    // a trace of every fuzzing run would be useless
+    if (!options.trace || options.fuzzing)
+        program->disableTrace();
+    if (options.cores > 1 && (!options.gdbAddress.empty() || options.fuzzing || options.lockstep
+                              || !options.engine.empty() || options.checkpointInterval || options.lastWrite))
+        throw std::runtime_error("-cores runs without -gdb, -fuzz, -lockstep, -engine and checkpoints");
+    if (!options.recordFile.empty() && !options.replayFile.empty())
+        throw std::runtime_error("Both -record and -replay are set");
+    if (!options.recordFile.empty())
+        eventLog = std::make_unique<EventLog>(options.recordFile, false);
+    if (!options.replayFile.empty())
+        eventLog = std::make_unique<EventLog>(options.replayFile, true);
+    if (options.lastWrite && !options.checkpointInterval)
+        options.checkpointInterval = DEFAULT_CHECKPOINT_INTERVAL;
+    // going back re-executes, device input has to come from a log
+    if (options.checkpointInterval && options.devices && !eventLog)
+        eventLog = std::make_unique<EventLog>("", false);
+    // going back does not take back what the guest wrote to the disk
+    if (!options.diskFile.empty() && options.checkpointInterval)
+        throw std::runtime_error("-disk runs without checkpoints");
+    // nor what it wrote through the semihost, and a lockstep copy would make every call twice
+    if (options.semihosting && (options.checkpointInterval || options.lockstep))
+        throw std::runtime_error("-semihost runs without -lockstep and checkpoints");
+    program->eventLog = eventLog.get();
+    program->devices = options.devices;
+    if (!options.diskFile.empty()) {
+        disk = std::make_unique<BlockDevice>(options.diskFile);
+        program->attachDisk(disk.get());
+    }
+    if (options.semihosting) {
+        semihost = std::make_unique<Semihost>();
+        program->semihost = semihost.get();
+    }
+    attachObservers();
 }
 
-void Emulator::execute() {
+void Emulator::attachObservers() {
+    if (!options.profileFile.empty())
+        observers.emplace_back(std::make_unique<CallProfiler>(options.profileFile, symbolMap));
+    if (options.stackUsage)
+        observers.emplace_back(std::make_unique<StackTracker>(symbolMap, options.stackGuard));
+    if (!options.cacheConfig.empty())
+        observers.emplace_back(std::make_unique<CacheSimulator>(
+                CacheSimulator::parseConfig(options.cacheConfig), symbolMap));
+    if (!options.coverageFile.empty())
+        observers.emplace_back(std::make_unique<Coverage>(options.coverageFile, options.coverageReport, symbolMap));
+    if (options.stats)
+        observers.emplace_back(std::make_unique<Statistics>(options.statsJson));
+    if (!options.snapshotFile.empty()) {
+        if (!options.snapshotAtPc && !options.snapshotAfter)
+            throw std::runtime_error("-snapshot needs -snapshot-at or -snapshot-after");
+        observers.emplace_back(std::make_unique<SnapshotWriter>(
+                options.snapshotFile, options.snapshotAtPc, options.snapshotAfter));
+    }
+    if (!options.forkInputs.empty()) {
+        if (!options.forkAtPc)
+            throw std::runtime_error("-fork-inputs needs -fork-at");
+        // children read their input through the keyboard
+        if (!options.devices || !options.replayFile.empty())
+            throw std::runtime_error("-fork-inputs needs -devices and runs without -replay");
+        observers.emplace_back(std::make_unique<ForkPoint>(
+                options.forkAtPc, ForkPoint::parseInputs(options.forkInputs),
+                std::vector<std::string *>{&options.dumpFile}));
+    }
+    if (options.checkpointInterval) {
+        auto travel = std::make_unique<TimeTravel>(options.checkpointInterval, options.checkpointBudget * MB);
+        timeTravel = travel.get();
+        observers.emplace_back(std::move(travel));
+    }
+
+    for (auto &observer: observers)
+        program->addObserver(observer.get());
+}
+
+int Emulator::execute() {
+    if (!options.batch.manifest.empty())
+        return BatchRunner(options.batch).run() ? EXIT_SUCCESS : EXIT_FAILURE;
+    if (!options.dumpDiff.empty() || !options.dumpCheck.empty())
+        return compareDumps();
+    // only what the run writes goes into the dump, not the loaded image
+    if (!options.dumpFile.empty())
+        program->memory.trackWrites();
     program->initNew();
-    while (true) {
-        program->executeCurrent();
-        if (program->isEnd)
-            break;
-        program->readNext();
-        program->setReg0();
+    if (options.stats)
+        program->memory.report(std::cerr);
+    if (options.devices && options.replayFile.empty())
+        program->startDevices();
+    try {
+        if (!options.gdbAddress.empty())
+            GdbStub(*program, timeTravel, options.gdbAddress).serve();
+        else if (options.fuzzing)
+            Fuzzer(*program, options.fuzz).run();
+        else if (options.cores > 1)
+            MultiCore(*program, options.cores, options.trace).run();
+        else if (options.lockstep)
+            // the engine under test, decoded unless -engine says otherwise
+            Lockstep(*program, Engine::create(options.engine.empty() ? "decoded" : options.engine)).run();
+        else if (!options.engine.empty() && options.engine != "reference") {
+            auto engine = Engine::create(options.engine);
+            while (!program->isEnd)
+                engine->runBlock(*program);
+        } else
+            while (!program->isEnd)
+                program->step();
+    } catch (...) {
+        // reports are still useful when the guest faults
+        program->notifyExit();
+        postMortem();
+        writeDump();
+        throw;
+    }
+    program->notifyExit();
+    postMortem();
+    writeDump();
+    return program->exitStatus;
+}
+
+void Emulator::writeDump() {
+    if (options.dumpFile.empty())
+        return;
+    MemoryDump::write(*program, options.dumpFile);
+}
+
+int Emulator::compareDumps() {
+    size_t differences;
+    if (!options.dumpCheck.empty()) {
+        if (options.expectFile.empty())
+            throw std::runtime_error("-dump-check needs -expect");
+        MemoryDump dump;
+        dump.load(options.dumpCheck);
+        differences = dump.check(options.expectFile, symbolMap, std::cout);
+    } else {
+        auto comma = options.dumpDiff.find(',');
+        if (comma == std::string::npos)
+            throw std::runtime_error("-dump-diff needs two dumps separated by a comma");
+        MemoryDump first, second;
+        first.load(options.dumpDiff.substr(0, comma));
+        second.load(options.dumpDiff.substr(comma + 1));
+        differences = MemoryDump::diff(first, second, std::cout);
+    }
+    return differences ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+void Emulator::postMortem() {
+    if (!options.lastWrite || timeTravel->checkpoints.empty())
+        return;
+    auto end = program->instrCounter;
+    std::cerr << "Last write to " << SymbolMap::hexAddr(options.lastWriteAddr) << ": ";
+    if (!timeTravel->reverseToLastWrite(*program, {{options.lastWriteAddr, 1}})) {
+        std::cerr << "none since instruction " << timeTravel->checkpoints[0].retired << '\n';
+        return;
     }
+    std::cerr << "instruction " << program->instrCounter + 1 << " of " << end
+              << " at " << symbolMap.symbolName(program->PC())
+              << " sp " << SymbolMap::hexAddr(program->SP()) << '\n';
 }
 
 
@@ -0,0 +1,384 @@
+#include "../include/engine.h"
+#include "../include/emulator.h"
+#include "../../common/include/program.h"
+
+bool Engine::endsBlock(uint32_t raw) {
+    Mnemonic instr{};
+    instr.value = raw;
+    switch (instr.byte_0) {
+        case XCHG:
+            return instr.REG_B == REG_PC || instr.REG_C == REG_PC;
+        case SWAP:
+        case CAS:
+            return instr.REG_C == REG_PC;
+        case ADD:
+        case SUB:
+        case MUL:
+        case DIV:
+        case NOT:
+        case AND:
+        case OR:
+        case XOR:
+        case SHL:
+        case SHR:
+        case LD_CSR:
+        case LD:
+        case LD_IND:
+            return instr.REG_A == REG_PC;
+        case ST_POST_INC:
+        case LD_POST_INC:
+            return instr.REG_A == REG_PC || instr.REG_B == REG_PC;
+        case CSR_LD_POST_INC:
+            return instr.REG_B == REG_PC;
+        case ST:
+        case ST_IND:
+        case CSR_LD:
+        case CSR_LD_OR:
+        case CSR_LD_IND:
+            return false;
+        default:
+            // halt, int, calls, jumps, branches, and anything the executor rejects
+            return true;
+    }
+}
+
+std::unique_ptr<Engine> Engine::create(const std::string &name) {
+    if (name == "reference")
+        return std::make_unique<ReferenceEngine>();
+    if (name == "decoded")
+        return std::make_unique<DecodedEngine>();
+    throw std::runtime_error("Unknown engine " + name);
+}
+
+void ReferenceEngine::runBlock(Program &program) {
+    while (true) {
+        auto raw = program.currInstr.value;
+        program.step();
+        if (program.isEnd || endsBlock(raw))
+            return;
+    }
+}
+
+std::vector<DecodedInstr> &DecodedEngine::decode(Program &program, uint32_t addr) {
+    std::vector<DecodedInstr> block;
+    Mnemonic instr{};
+    for (auto pc = addr;; pc += INSTR_SIZE) {
+        instr.value = program.memory.readWord(pc);
+        block.push_back({instr.value, (uint8_t) instr.byte_0, (uint8_t) instr.REG_A, (uint8_t) instr.REG_B,
+                         (uint8_t) instr.REG_C, program.castToSign(instr.DISPLACEMENT, 12)});
+        classify(program, pc, block.back());
+        decodedWords.insert(pc);
+        if (endsBlock(instr.value) || block.size() == DECODED_BLOCK_MAX)
+            break;
+    }
+    // writes to these segments are checked against the decoded words, a hit drops every block
+    program.memory.setFlags(addr, block.size() * INSTR_SIZE, SEG_CODE);
+    if (!program.memory.codeWriteHandler)
+        program.memory.codeWriteHandler = [this](uint32_t written) {
+            if (decodedWords.count(written & ~3u) || decodedWords.count((written + 3) & ~3u))
+                flushPending = true;
+        };
+    return blocks[addr] = std::move(block);
+}
+
+void DecodedEngine::classify(Program &program, uint32_t pc, DecodedInstr &instr) {
+    // the registers the address is summed from, r0 reads as zero
+    uint8_t first, second = 0;
+    switch (instr.opcode) {
+        case LD_IND:
+        case CSR_LD_IND:
+            first = instr.b;
+            second = instr.c;
+            break;
+        case ST:
+        case ST_IND:
+        case CALL_MEM:
+            first = instr.a;
+            second = instr.b;
+            break;
+        case JMP_MEM:
+        case BEQ_MEM:
+        case BNE_MEM:
+        case BGT_MEM:
+            first = instr.a;
+            break;
+        case ST_POST_INC:
+            if (instr.a == REG_SP)
+                instr.access = ACCESS_STACK;
+            return;
+        case LD_POST_INC:
+        case CSR_LD_POST_INC:
+            if (instr.b == REG_SP)
+                instr.access = ACCESS_STACK;
+            return;
+        default:
+            return;
+    }
+    if (second == REG_PC || second == REG_SP)
+        std::swap(first, second);
+    if (second != 0)
+        return;
+    if (first == REG_SP && (instr.opcode == LD_IND || instr.opcode == ST))
+        instr.access = ACCESS_STACK;
+    // pc is the address of the instruction while it executes, only reads go through the literal path
+    uint32_t addr = pc + instr.disp;
+    if (first != REG_PC || instr.opcode == ST || addr % 4 != 0)
+        return;
+    auto &memory = program.memory;
+    instr.access = ACCESS_LITERAL;
+    instr.offset = addr % memory._segmentSize;
+    instr.segment = &memory.getSegment(memory.getSegmentIndex(addr));
+}
+
+int32_t DecodedEngine::load(Program &program, const DecodedInstr &instr, uint32_t addr) {
+    if (!unchecked || instr.access == ACCESS_CHECKED)
+        return program.getMemory(addr);
+    if (instr.access == ACCESS_STACK)
+        return readStack(program, addr);
+    return instr.segment->readWord(instr.offset);
+}
+
+void DecodedEngine::store(Program &program, const DecodedInstr &instr, uint32_t addr, int32_t value) {
+    if (unchecked && instr.access == ACCESS_STACK)
+        writeStack(program, addr, value);
+    else
+        program.setMemory(addr, value);
+}
+
+Segment &DecodedEngine::stack(Program &program, uint32_t addr) {
+    // inside the cached segment there is nothing to look up or range check, it was valid when it was cached
+    if (stackSegment && addr - stackBase < program.memory._segmentSize)
+        return *stackSegment;
+    stackIndex = program.memory.getSegmentIndex(addr);
+    stackSegment = &program.memory.getSegment(stackIndex);
+    stackBase = program.memory._minAddr + (uint64_t) stackIndex * program.memory._segmentSize;
+    return *stackSegment;
+}
+
+int32_t DecodedEngine::readStack(Program &program, uint32_t addr) {
+    // an aligned word never straddles two segments
+    if (addr % 4 != 0)
+        return program.getMemory(addr);
+    return stack(program, addr).readWord(addr % program.memory._segmentSize);
+}
+
+void DecodedEngine::writeStack(Program &program, uint32_t addr, int32_t value) {
+    if (addr % 4 != 0)
+        return program.setMemory(addr, value);
+    auto &segment = stack(program, addr);
+    if (segment.flags != SEG_DIRTY)
+        program.memory.touch(stackIndex, segment, addr);
+    segment.writeWord(addr % program.memory._segmentSize, value);
+}
+
+void DecodedEngine::push(Program &program, int32_t value) {
+    if (!unchecked)
+        return program.push(value);
+    if (program.SP() < program.memory._minAddr)
+        throw std::runtime_error("Stack overflow!");
+    program.SP() -= STACK_INCREMENT;
+    writeStack(program, program.SP(), value);
+}
+
+void DecodedEngine::runBlock(Program &program) {
+    if (program.memory.generation != generation) {
+        // memory was restored, the decoded words and the segments of the literals are gone
+        blocks.clear();
+        decodedWords.clear();
+        stackSegment = nullptr;
+        generation = program.memory.generation;
+    }
+    // observers count every fetch, load and store, the checked path reports them
+    unchecked = !program.trace && program.memoryObservers.empty();
+    auto it = blocks.find(program.PC());
+    auto &block = it != blocks.end() ? it->second : decode(program, program.PC());
+    for (auto &instr: block) {
+        program.currInstr.value = instr.raw;
+        if (program.trace)
+            program.logState();
+        ++program.instrCounter;
+        try {
+            for (auto *observer: program.observers)
+                observer->onExecute(program);
+            execute(program, instr);
+        } catch (...) {
+            // same as Program::step, the faulting instruction did not retire
+            --program.instrCounter;
+            throw;
+        }
+        if (program.trace)
+            program.logState();
+        *program.LOG << '\n';
+        if (program.isEnd)
+            return;
+        if (program.incrementPC)
+            program.PC() += INSTR_SIZE;
+        program.incrementPC = true;
+        // where the reference interpreter fetches the next instruction
+        for (auto *observer: program.memoryObservers)
+            observer->onFetch(program, program.PC());
+        program.setReg0();
+        auto next = program.PC();
+        if (program.devices)
+            program.handleInterrupts();
+        if (program.semihost) {
+            program.handleSemihost();
+            if (program.isEnd)
+                return;
+        }
+        if (flushPending) {
+            // self-modifying code, block may be gone
+            blocks.clear();
+            decodedWords.clear();
+            program.memory.clearFlags(SEG_CODE);
+            flushPending = false;
+            return;
+        }
+        if (program.PC() != next)
+            return;
+    }
+}
+
+void DecodedEngine::execute(Program &program, const DecodedInstr &instr) {
+    auto &gpr = program.gpr_registers;
+    auto &csr = program.csr_registers;
+    int32_t temp;
+    switch (instr.opcode) {
+        case HALT:
+            program.isEnd = true;
+            break;
+        case INT:
+            temp = program.PC();
+            push(program, program.STATUS());
+            push(program, program.PC());
+            program.CAUSE() = STATUS::SOFTWARE;
+            program.STATUS() &= ~0x1;
+            program.PC() = program.HANDLER();
+            program.incrementPC = false;
+            program.notifyInterrupt(STATUS::SOFTWARE, temp);
+            break;
+        case CALL:
+            temp = program.PC();
+            push(program, program.PC());
+            program.PC() = gpr[instr.a] + gpr[instr.b] + instr.disp;
+            program.incrementPC = false;
+            program.notifyCall(temp);
+            break;
+        case CALL_MEM:
+            temp = program.PC();
+            push(program, program.PC());
+            program.PC() = load(program, instr, gpr[instr.a] + gpr[instr.b] + instr.disp);
+            program.incrementPC = false;
+            program.notifyCall(temp);
+            break;
+        case JMP:
+            program.jump(gpr[instr.a] + instr.disp);
+            break;
+        case BEQ:
+            if (gpr[instr.b] == gpr[instr.c])
+                program.jump(gpr[instr.a] + instr.disp);
+            break;
+        case BNE:
+            if (gpr[instr.b] != gpr[instr.c])
+                program.jump(gpr[instr.a] + instr.disp);
+            break;
+        case BGT:
+            if (gpr[instr.b] > gpr[instr.c])
+                program.jump(gpr[instr.a] + instr.disp);
+            break;
+        case JMP_MEM:
+            program.jump(load(program, instr, gpr[instr.a] + instr.disp));
+            break;
+        case BEQ_MEM:
+            if (gpr[instr.b] == gpr[instr.c])
+                program.jump(load(program, instr, gpr[instr.a] + instr.disp));
+            break;
+        case BNE_MEM:
+            if (gpr[instr.b] != gpr[instr.c])
+                program.jump(load(program, instr, gpr[instr.a] + instr.disp));
+            break;
+        case BGT_MEM:
+            if (gpr[instr.b] > gpr[instr.c])
+                program.jump(load(program, instr, gpr[instr.a] + instr.disp));
+            break;
+        case XCHG:
+            std::swap(gpr[instr.b], gpr[instr.c]);
+            break;
+        case SWAP:
+            gpr[instr.c] = program.exchangeMemory(gpr[instr.a], gpr[instr.c]);
+            break;
+        case CAS:
+            gpr[instr.c] = program.compareExchangeMemory(gpr[instr.a], gpr[instr.b], gpr[instr.c]);
+            break;
+        case ADD:
+            gpr[instr.a] = program.sum(gpr[instr.b], gpr[instr.c]);
+            break;
+        case SUB:
+            gpr[instr.a] = program.sub(gpr[instr.b], gpr[instr.c]);
+            break;
+        case MUL:
+            gpr[instr.a] = program.mul(gpr[instr.b], gpr[instr.c]);
+            break;
+        case DIV:
+            gpr[instr.a] = program.div(gpr[instr.b], gpr[instr.c]);
+            break;
+        case NOT:
+            gpr[instr.a] = program.not_(gpr[instr.b]);
+            break;
+        case AND:
+            gpr[instr.a] = gpr[instr.b] & gpr[instr.c];
+            break;
+        case OR:
+            gpr[instr.a] = program.or_(gpr[instr.b], gpr[instr.c]);
+            break;
+        case XOR:
+            gpr[instr.a] = program.xor_(gpr[instr.b], gpr[instr.c]);
+            break;
+        case SHL:
+            gpr[instr.a] = program.shl(gpr[instr.b], gpr[instr.c]);
+            break;
+        case SHR:
+            gpr[instr.a] = program.shr(gpr[instr.b], gpr[instr.c]);
+            break;
+        case ST:
+            store(program, instr, gpr[instr.a] + gpr[instr.b] + instr.disp, gpr[instr.c]);
+            break;
+        case ST_IND:
+            program.setMemory(load(program, instr, gpr[instr.a] + gpr[instr.b] + instr.disp), gpr[instr.c]);
+            break;
+        case ST_POST_INC:
+            gpr[instr.a] += instr.disp;
+            store(program, instr, gpr[instr.a], gpr[instr.c]);
+            break;
+        case LD_CSR:
+            gpr[instr.a] = csr[instr.b];
+            break;
+        case LD:
+            gpr[instr.a] = gpr[instr.b] + instr.disp;
+            break;
+        case LD_IND:
+            gpr[instr.a] = load(program, instr, gpr[instr.b] + gpr[instr.c] + instr.disp);
+            break;
+        case LD_POST_INC:
+            gpr[instr.a] = load(program, instr, gpr[instr.b]);
+            gpr[instr.b] += instr.disp;
+            if (instr.a == REG_PC)
+                program.notifyReturn();
+            break;
+        case CSR_LD:
+            csr[instr.a] = gpr[instr.b];
+            break;
+        case CSR_LD_OR:
+            csr[instr.a] = csr[instr.b] | instr.disp;
+            break;
+        case CSR_LD_IND:
+            csr[instr.a] = load(program, instr, gpr[instr.b] + gpr[instr.c] + instr.disp);
+            break;
+        case CSR_LD_POST_INC:
+            csr[instr.a] = load(program, instr, gpr[instr.b]);
+            gpr[instr.b] += instr.disp;
+            break;
+        default:
+            throw std::runtime_error("Unknown instruction " + std::to_string(instr.raw));
+    }
+}
@@ -0,0 +1,78 @@
+#include "../include/event_log.h"
+
+#include <stdexcept>
+#include <algorithm>
+
+EventLog::EventLog(std::string file, bool replaying)
+        : replaying(replaying), recording(!replaying), file(std::move(file)) {
+    if (!replaying) {
+        if (this->file.empty())
+            return;
+        out.open(this->file, std::ios::binary);
+        if (!out)
+            throw std::runtime_error("Failed to open file: " + this->file);
+        return;
+    }
+    std::ifstream in(this->file, std::ios::binary);
+    if (!in.is_open())
+        throw std::runtime_error("Could not open file " + this->file);
+    DeviceEvent event{};
+    while (in.read(reinterpret_cast<char *>(&event.instr), sizeof(event.instr))
+           && in.read(reinterpret_cast<char *>(&event.type), sizeof(event.type))
+           && in.read(reinterpret_cast<char *>(&event.value), sizeof(event.value)))
+        events.push_back(event);
+    in.close();
+}
+
+void EventLog::record(const DeviceEvent &event) {
+    events.push_back(event);
+    nextEvent = events.size();
+    if (!out.is_open())
+        return;
+    // flushed so a crashing run still leaves its events
+    write(event);
+    out.flush();
+}
+
+void EventLog::moveTo(std::string newFile) {
+    out.close();
+    file = std::move(newFile);
+    out.open(file, std::ios::binary);
+    if (!out)
+        throw std::runtime_error("Failed to open file: " + file);
+    for (auto &event: events)
+        write(event);
+    out.flush();
+}
+
+void EventLog::write(const DeviceEvent &event) {
+    // packed 13-byte records
+    out.write(reinterpret_cast<const char *>(&event.instr), sizeof(event.instr));
+    out.write(reinterpret_cast<const char *>(&event.type), sizeof(event.type));
+    out.write(reinterpret_cast<const char *>(&event.value), sizeof(event.value));
+}
+
+bool EventLog::next(uint64_t instr, DeviceEvent &event, bool semihost) {
+    if (nextEvent == events.size()) {
+        // re-execution caught up with the recording, back to live devices
+        if (recording)
+            replaying = false;
+        return false;
+    }
+    if (events[nextEvent].instr > instr || (events[nextEvent].type == EV_SEMIHOST) != semihost)
+        return false;
+    if (events[nextEvent].instr < instr)
+        throw std::runtime_error("Replay diverged, event at instruction " + std::to_string(events[nextEvent].instr)
+                                 + " was not delivered");
+    event = events[nextEvent++];
+    return true;
+}
+
+void EventLog::seek(uint64_t instr) {
+    // events at instr were delivered before the state at instr was captured
+    nextEvent = std::upper_bound(events.begin(), events.end(), instr, [](uint64_t value, const DeviceEvent &event) {
+        return value < event.instr;
+    }) - events.begin();
+    if (recording)
+        replaying = nextEvent < events.size();
+}
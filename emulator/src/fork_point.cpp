@@ -0,0 +1,87 @@
+#include "../include/fork_point.h"
+#include "../include/event_log.h"
+#include "../../common/include/program.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <sstream>
+#include <iostream>
+#include <unistd.h>
+#include <sys/wait.h>
+
+std::vector<std::string> ForkPoint::parseInputs(const std::string &str) {
+    std::vector<std::string> inputs;
+    std::istringstream iss(str);
+    std::string input;
+    while (std::getline(iss, input, ','))
+        if (!input.empty())
+            inputs.push_back(input);
+    return inputs;
+}
+
+std::string ForkPoint::childFile(const std::string &input, const std::string &file) {
+    if (file.empty())
+        return file;
+    return input + "." + std::filesystem::path(file).filename().string();
+}
+
+void ForkPoint::redirect(Program &program, const std::string &input) {
+    if (!freopen(input.c_str(), "r", stdin))
+        throw std::runtime_error("Could not open file " + input);
+    // the parent's keyboard thread may have left std::cin at the end of its own stdin
+    std::cin.clear();
+    if (!freopen((input + ".out").c_str(), "w", stdout))
+        throw std::runtime_error("Failed to open file: " + input + ".out");
+    if (!freopen((input + ".err").c_str(), "w", stderr))
+        throw std::runtime_error("Failed to open file: " + input + ".err");
+    program.LOG = std::make_unique<std::ofstream>(input + ".log");
+    if (!program.LOG->is_open())
+        throw std::runtime_error("Could not open log file!");
+    if (!program.trace)
+        program.disableTrace();
+}
+
+void ForkPoint::onExecute(Program &program) {
+    if (forked || (uint32_t) program.PC() != forkPc)
+        return;
+    forked = true;
+    // buffered output would be written once by every child
+    program.LOG->flush();
+    std::cout.flush();
+    std::cerr.flush();
+
+    std::vector<int> children;
+    for (auto &input: inputs) {
+        auto pid = fork();
+        if (pid < 0)
+            throw std::runtime_error("fork() failed for " + input);
+        if (pid == 0) {
+            // child continues with the instruction at the fork point
+            redirect(program, input);
+            for (auto *output: outputs)
+                *output = childFile(input, *output);
+            // one shared recording would interleave the children's events
+            if (program.eventLog && program.eventLog->out.is_open())
+                program.eventLog->moveTo(childFile(input, program.eventLog->file));
+            for (auto *observer: program.observers)
+                observer->onFork(program, input);
+            // fork() kept only this thread, the keyboard thread has to read the new stdin
+            program.startDevices();
+            return;
+        }
+        children.push_back(pid);
+    }
+    waitChildren(children);
+}
+
+void ForkPoint::waitChildren(const std::vector<int> &children) const {
+    int failed = 0;
+    for (size_t i = 0; i < children.size(); ++i) {
+        int status;
+        waitpid(children[i], &status, 0);
+        auto ok = WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+        failed += !ok;
+        std::cerr << inputs[i] << ": " << (ok ? "ok" : "failed") << '\n';
+    }
+    exit(failed ? EXIT_FAILURE : EXIT_SUCCESS);
+}
@@ -0,0 +1,242 @@
+#include "../include/fuzzer.h"
+#include "../include/emulator.h"
+#include "../../common/include/log.h"
+#include "../../common/include/program.h"
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+
+void FuzzCoverage::onExecute(Program &program) {
+    auto current = ((uint32_t) program.PC() >> 2) & (FUZZ_MAP_SIZE - 1);
+    auto edge = current ^ previous;
+    if (!hits[edge]++)
+        touched.push_back(edge);
+    previous = current >> 1;
+}
+
+void FuzzCoverage::reset() {
+    // only what the run touched
+    for (auto edge: touched)
+        hits[edge] = 0;
+    touched.clear();
+    previous = 0;
+}
+
+Fuzzer::Fuzzer(Program &program, FuzzConfig config) : program(program), config(std::move(config)),
+                                                      random(this->config.seed) {
+    if (!this->config.terminal && !this->config.buffer)
+        throw std::runtime_error("Fuzzing needs -fuzz-buffer or -fuzz-terminal");
+}
+
+void Fuzzer::capture() {
+    // run the program up to the entry point once, with no input
+    while ((uint32_t) program.PC() != config.entry) {
+        program.step();
+        if (program.isEnd)
+            throw std::runtime_error("Program halted before the fuzzing entry " + std::to_string(config.entry));
+    }
+    gpr = program.gpr_registers;
+    csr = program.csr_registers;
+    psw = program.psw.val;
+    keyboardBuf = program.keyboardBuf;
+    keyBarrier = program.keyBarrier;
+    entryInstructions = program.instrCounter;
+    for (auto &segment: program.memory._segments)
+        snapshot[segment.first] = segment.second->data;
+    program.memory.takeDirty();
+    program.addObserver(&coverage);
+}
+
+void Fuzzer::reset() {
+    // cost follows the segments the run wrote, not the image size
+    for (auto index: program.memory.takeDirty()) {
+        auto &data = program.memory._segments.at(index)->data;
+        auto it = snapshot.find(index);
+        if (it != snapshot.end())
+            data = it->second;
+        else
+            std::fill(data.begin(), data.end(), 0);
+        ++resetSegments;
+    }
+    program.gpr_registers = gpr;
+    program.csr_registers = csr;
+    program.psw.val = psw;
+    // a key typed by the last run must not reach the next one
+    program.keyboardBuf = keyboardBuf;
+    program.keyBarrier = keyBarrier;
+    program.lastTimerExecution = std::chrono::system_clock::now();
+    program.exitStatus = 0;
+    program.instrCounter = entryInstructions;
+    program.isEnd = false;
+    program.incrementPC = true;
+    program.loadInstr();
+    coverage.reset();
+}
+
+std::string Fuzzer::execute(const std::vector<uint8_t> &input) {
+    if (!config.terminal) {
+        program.memory.writeWord(config.buffer, input.size());
+        for (uint32_t i = 0; i < input.size(); i += 4) {
+            uint32_t word = 0;
+            for (uint32_t j = 0; j < 4 && i + j < input.size(); ++j)
+                word |= input[i + j] << (8 * j);
+            program.memory.writeWord(config.buffer + 4 + i, word);
+        }
+    }
+    size_t typed = 0;
+    auto limit = entryInstructions + config.timeout;
+    try {
+        while (!program.isEnd) {
+            if (program.instrCounter >= limit)
+                return "hang";
+            program.step();
+            if (config.terminal && typed < input.size()
+                && (program.instrCounter - entryInstructions) % FUZZ_KEY_INTERVAL == 0
+                && program.keyInterr((char) input[typed]))
+                ++typed;
+        }
+    } catch (std::runtime_error &error) {
+        return error.what();
+    }
+    return "";
+}
+
+bool Fuzzer::newCoverage() {
+    bool found = false;
+    for (auto edge: coverage.touched)
+        if (!seen[edge]) {
+            seen[edge] = true;
+            ++edges;
+            found = true;
+        }
+    return found;
+}
+
+std::vector<uint8_t> Fuzzer::mutate(const std::vector<uint8_t> &parent) {
+    auto child = parent;
+    auto rounds = 1 + random() % 8;
+    for (uint32_t i = 0; i < rounds; ++i) {
+        auto position = child.empty() ? 0 : random() % child.size();
+        switch (random() % 6) {
+            case 0:
+                if (!child.empty())
+                    child[position] ^= 1 << (random() % 8);
+                break;
+            case 1:
+                if (!child.empty())
+                    child[position] = random();
+                break;
+            case 2:
+                if (child.size() < config.maxLength)
+                    child.insert(child.begin() + position, (uint8_t) random());
+                break;
+            case 3:
+                if (!child.empty())
+                    child.erase(child.begin() + position);
+                break;
+            case 4: {
+                // interesting values
+                static const uint8_t values[] = {0, 1, 0x7f, 0x80, 0xff, '\n', '\r', ' ', '0', 'a'};
+                if (!child.empty())
+                    child[position] = values[random() % sizeof(values)];
+                break;
+            }
+            default: {
+                // splice with another corpus entry
+                auto &other = corpus[random() % corpus.size()];
+                if (other.empty())
+                    break;
+                auto from = random() % other.size();
+                child.insert(child.begin() + position, other.begin() + from, other.end());
+                break;
+            }
+        }
+    }
+    if (child.size() > config.maxLength)
+        child.resize(config.maxLength);
+    return child;
+}
+
+void Fuzzer::save(const std::string &kind, const std::vector<uint8_t> &input) {
+    auto file = config.crashDir + "/" + kind + "-" + std::to_string(kind == "hang" ? hangPcs.size() : crashKinds.size())
+                + ".bin";
+    std::ofstream out(file, std::ios::binary);
+    if (!out)
+        throw std::runtime_error("Failed to open file: " + file);
+    out.write(reinterpret_cast<const char *>(input.data()), input.size());
+    out.close();
+}
+
+void Fuzzer::loadCorpus() {
+    if (!config.corpusDir.empty())
+        for (auto &entry: std::filesystem::directory_iterator(config.corpusDir)) {
+            std::ifstream in(entry.path(), std::ios::binary);
+            std::vector<uint8_t> input((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            if (input.size() > config.maxLength)
+                input.resize(config.maxLength);
+            corpus.push_back(std::move(input));
+        }
+    if (corpus.empty())
+        corpus.emplace_back();
+}
+
+void Fuzzer::run() {
+    capture();
+    loadCorpus();
+    auto start = std::chrono::steady_clock::now();
+    auto lastReport = start;
+    // seeds run as they are, then mutated corpus entries
+    auto seeds = corpus.size();
+    for (uint64_t i = 0; !config.runs || i < config.runs; ++i) {
+        auto input = i < seeds ? corpus[i] : mutate(corpus[random() % corpus.size()]);
+        auto result = execute(input);
+        ++runs;
+        if (result == "hang") {
+            if (hangPcs.insert(program.PC()).second) {
+                save("hang", input);
+                std::cerr << "Hang " << hangPcs.size() << ": at " << SymbolMap::hexAddr(program.PC()) << '\n';
+            }
+            ++hangs;
+        } else if (!result.empty()) {
+            auto kind = result + " at " + SymbolMap::hexAddr(program.PC());
+            if (crashKinds.insert(kind).second) {
+                save("crash", input);
+                std::cerr << "Crash " << crashKinds.size() << ": " << kind << '\n';
+            }
+            ++crashes;
+        }
+        if (newCoverage() && i >= seeds)
+            corpus.push_back(input);
+        reset();
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastReport >= std::chrono::seconds(FUZZ_REPORT_INTERVAL)) {
+            lastReport = now;
+            std::chrono::duration<double> elapsed = now - start;
+            std::cerr << "runs " << runs << ", " << (uint64_t) (runs / elapsed.count()) << "/s, corpus "
+                      << corpus.size() << ", edges " << edges << ", crashes " << crashes << ", hangs " << hangs
+                      << '\n';
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    report(std::cerr, elapsed.count());
+    // the machine ends in its entry state
+    program.isEnd = true;
+}
+
+void Fuzzer::report(std::ostream &out, double seconds) const {
+    Log::tableName(out, "Fuzzing");
+    out << std::left << std::dec
+        << std::setw(25) << "Runs" << runs << "\n"
+        << std::setw(25) << "Runs per second" << (uint64_t) (runs / seconds) << "\n"
+        << std::setw(25) << "Corpus" << corpus.size() << "\n"
+        << std::setw(25) << "Edges" << edges << "\n"
+        << std::setw(25) << "Crashes" << crashes << " (" << crashKinds.size() << " unique)\n"
+        << std::setw(25) << "Hangs" << hangs << " (" << hangPcs.size() << " unique)\n"
+        << std::setw(25) << "Segments reset per run" << std::fixed << std::setprecision(2)
+        << (runs ? (double) resetSegments / (double) runs : 0.0) << "\n"
+        << std::setw(25) << "Snapshot segments" << snapshot.size() << "\n";
+    Log::tableFooter(out);
+}
@@ -0,0 +1,425 @@
+#include "../include/gdb_stub.h"
+#include "../include/time_travel.h"
+#include "../../common/include/program.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <poll.h>
+#include <cstring>
+#include <cstdio>
+#include <sstream>
+#include <iostream>
+#include <stdexcept>
+
+GdbStub::GdbStub(Program &program, TimeTravel *timeTravel, const std::string &address)
+        : program(program), timeTravel(timeTravel) {
+    if (address.compare(0, 5, "unix:") == 0) {
+        auto path = address.substr(5);
+        sockaddr_un addr{};
+        if (path.size() >= sizeof(addr.sun_path))
+            throw std::runtime_error("Socket path too long: " + path);
+        addr.sun_family = AF_UNIX;
+        std::strcpy(addr.sun_path, path.c_str());
+        unlink(path.c_str());
+        listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listenFd < 0 || bind(listenFd, (sockaddr *) &addr, sizeof(addr)) < 0)
+            throw std::runtime_error("Could not bind " + address);
+    } else {
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(std::stoi(address));
+        listenFd = socket(AF_INET, SOCK_STREAM, 0);
+        int reuse = 1;
+        setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        if (listenFd < 0 || bind(listenFd, (sockaddr *) &addr, sizeof(addr)) < 0)
+            throw std::runtime_error("Could not bind port " + address);
+    }
+    if (listen(listenFd, 1) < 0)
+        throw std::runtime_error("Could not listen on " + address);
+    std::cerr << "Waiting for GDB on " << address << '\n';
+    fd = accept(listenFd, nullptr, nullptr);
+    if (fd < 0)
+        throw std::runtime_error("Could not accept a connection on " + address);
+    int noDelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+    program.memory.watchHandler = [this](uint32_t addr) {
+        // page granularity got us here, now the exact ranges
+        for (auto &watchpoint: watchpoints)
+            if (addr < watchpoint.first + watchpoint.second && watchpoint.first < addr + 4) {
+                watchTriggered = true;
+                watchAddr = watchpoint.first;
+            }
+    };
+}
+
+GdbStub::~GdbStub() {
+    program.memory.watchHandler = nullptr;
+    if (fd >= 0)
+        close(fd);
+    if (listenFd >= 0)
+        close(listenFd);
+}
+
+void GdbStub::serve() {
+    std::string packet;
+    bool running = true;
+    while (running) {
+        if (!receive(packet)) {
+            // the debugger went away, let the guest finish on its own
+            detach();
+            return;
+        }
+        std::string reply;
+        try {
+            reply = handle(packet, running);
+        } catch (std::invalid_argument &) {
+            // a field that is not a number, guest faults are runtime errors and still end the session
+            reply = "E01";
+        } catch (std::out_of_range &) {
+            reply = "E01";
+        }
+        send(reply);
+        if (packet == "QStartNoAckMode")
+            ack = false;
+        if (packet == "D") {
+            detach();
+            return;
+        }
+    }
+}
+
+int GdbStub::readByte() {
+    if (input.empty()) {
+        char buffer[GDB_PACKET_SIZE];
+        auto n = read(fd, buffer, sizeof(buffer));
+        if (n <= 0)
+            return -1;
+        input.assign(buffer, n);
+    }
+    auto c = (uint8_t) input[0];
+    input.erase(0, 1);
+    return c;
+}
+
+bool GdbStub::receive(std::string &packet) {
+    // $data#cs, anything before '$' is an ack or a stray ^C
+    while (true) {
+        int c;
+        while ((c = readByte()) != '$')
+            if (c < 0)
+                return false;
+        packet.clear();
+        uint8_t sum = 0;
+        while ((c = readByte()) != '#') {
+            if (c < 0)
+                return false;
+            packet += (char) c;
+            sum += c;
+        }
+        char checksum[3] = {0, 0, 0};
+        for (int i = 0; i < 2; ++i) {
+            if ((c = readByte()) < 0)
+                return false;
+            checksum[i] = (char) c;
+        }
+        if (!ack)
+            return true;
+        if (std::strtoul(checksum, nullptr, 16) == sum) {
+            write(fd, "+", 1);
+            return true;
+        }
+        write(fd, "-", 1);
+    }
+}
+
+void GdbStub::send(const std::string &reply) {
+    uint8_t sum = 0;
+    for (auto c: reply)
+        sum += c;
+    char checksum[4];
+    std::snprintf(checksum, sizeof(checksum), "#%02x", sum);
+    auto packet = "$" + reply + checksum;
+    while (true) {
+        write(fd, packet.data(), packet.size());
+        if (!ack)
+            return;
+        int c;
+        while ((c = readByte()) != '+' && c != '-')
+            if (c < 0)
+                return;
+        if (c == '+')
+            return;
+    }
+}
+
+std::string GdbStub::handle(const std::string &packet, bool &running) {
+    auto command = packet.empty() ? '\0' : packet[0];
+    auto args = packet.size() > 1 ? packet.substr(1) : "";
+    switch (command) {
+        case '?':
+            return "S05";
+        case 'g': {
+            std::string reply;
+            for (int i = 0; i < GDB_NUM_REGS; ++i)
+                reply += hexWord(readRegister(i));
+            return reply;
+        }
+        case 'G':
+            for (int i = 0; i < GDB_NUM_REGS && (size_t) (i + 1) * 8 <= args.size(); ++i)
+                writeRegister(i, parseWord(args.substr(i * 8, 8)));
+            return "OK";
+        case 'p': {
+            auto reg = std::stoi(args, nullptr, 16);
+            return reg >= 0 && reg < GDB_NUM_REGS ? hexWord(readRegister(reg)) : "E01";
+        }
+        case 'P': {
+            auto reg = std::stoi(args, nullptr, 16);
+            if (reg < 0 || reg >= GDB_NUM_REGS || args.find('=') == std::string::npos)
+                return "E01";
+            writeRegister(reg, parseWord(args.substr(args.find('=') + 1)));
+            return "OK";
+        }
+        case 'm': {
+            auto comma = args.find(',');
+            return readMemory(std::stoul(args, nullptr, 16), std::stoul(args.substr(comma + 1), nullptr, 16));
+        }
+        case 'M': {
+            auto colon = args.find(':');
+            writeMemory(std::stoul(args, nullptr, 16), args.substr(colon + 1));
+            return "OK";
+        }
+        case 'c':
+        case 's':
+            if (!args.empty())
+                writeRegister(REG_PC, std::stoul(args, nullptr, 16));
+            return resume(command == 's');
+        case 'b':
+            if (!timeTravel || (args != "s" && args != "c"))
+                return "";
+            return reverse(args == "s");
+        case 'Z':
+        case 'z': {
+            // Z0 software breakpoint, Z2 write watchpoint
+            auto type = args.empty() ? '\0' : args[0];
+            auto addr = (uint32_t) std::stoul(args.substr(2), nullptr, 16);
+            auto len = (uint32_t) std::stoul(args.substr(args.find(',', 2) + 1), nullptr, 16);
+            if (type == '0') {
+                if (command == 'Z')
+                    program.breakpoints.insert(addr);
+                else
+                    program.breakpoints.erase(addr);
+                return "OK";
+            }
+            if (type == '2') {
+                if (command == 'Z')
+                    watchpoints.emplace_back(addr, len);
+                else
+                    for (auto it = watchpoints.begin(); it != watchpoints.end(); ++it)
+                        if (it->first == addr && it->second == len) {
+                            watchpoints.erase(it);
+                            break;
+                        }
+                updateWatches();
+                return "OK";
+            }
+            return "";
+        }
+        case 'k':
+            program.isEnd = true;
+            running = false;
+            return "OK";
+        case 'D':
+            return "OK";
+        case 'H':
+            return "OK";
+        case 'q':
+            if (packet.compare(0, 10, "qSupported") == 0)
+                return "PacketSize=" + std::to_string(GDB_PACKET_SIZE) + ";qXfer:features:read+;swbreak+"
+                       + ";QStartNoAckMode+" + (timeTravel ? ";ReverseStep+;ReverseContinue+" : "");
+            if (packet.compare(0, 31, "qXfer:features:read:target.xml:") == 0) {
+                auto xml = targetXml();
+                auto range = packet.substr(31);
+                auto offset = std::stoul(range, nullptr, 16);
+                auto length = std::stoul(range.substr(range.find(',') + 1), nullptr, 16);
+                if (offset >= xml.size())
+                    return "l";
+                auto chunk = xml.substr(offset, length);
+                return (offset + length >= xml.size() ? "l" : "m") + chunk;
+            }
+            if (packet == "qAttached")
+                return "1";
+            if (packet == "qC")
+                return "QC1";
+            if (packet == "qfThreadInfo")
+                return "m1";
+            if (packet == "qsThreadInfo")
+                return "l";
+            return "";
+        case 'Q':
+            return packet == "QStartNoAckMode" ? "OK" : "";
+        default:
+            return "";
+    }
+}
+
+std::string GdbStub::resume(bool single) {
+    watchTriggered = false;
+    try {
+        // the current instruction runs without its breakpoint
+        if (!program.isEnd)
+            program.step();
+        if (!single && !program.isEnd && !watchTriggered) {
+            program.insertBreakpoints();
+            if (program.breakpoints.count(program.PC()))
+                program.currInstr.value = BREAKPOINT;
+            while (!program.isEnd && !watchTriggered && !interrupted())
+                for (int i = 0; i < GDB_POLL_INTERVAL && !program.isEnd && !watchTriggered; ++i)
+                    program.step();
+            program.removeBreakpoints();
+        }
+    } catch (std::runtime_error &) {
+        program.removeBreakpoints();
+        send("X0b");
+        throw;
+    }
+    if (program.breakHit) {
+        program.breakHit = false;
+        program.isEnd = false;
+        return "T05swbreak:;";
+    }
+    if (program.isEnd)
+        return "W00";
+    if (watchTriggered)
+        return "T05watch:" + hexValue(watchAddr) + ";";
+    return single ? "S05" : "S02";
+}
+
+std::string GdbStub::reverse(bool single) {
+    bool moved;
+    if (single)
+        moved = timeTravel->reverseStep(program);
+    else if (!watchpoints.empty())
+        moved = timeTravel->reverseToLastWrite(program, watchpoints);
+    else
+        moved = false;
+    if (!single && !moved && !timeTravel->checkpoints.empty())
+        timeTravel->goTo(program, timeTravel->checkpoints[0].retired);
+    // re-execution does not stop for the debugger
+    watchTriggered = false;
+    if (!moved)
+        return "T05replaylog:begin;";
+    if (single)
+        return "S05";
+    return "T05watch:" + hexValue(timeTravel->lastWriteAddr) + ";";
+}
+
+bool GdbStub::interrupted() {
+    pollfd pending{fd, POLLIN, 0};
+    if (poll(&pending, 1, 0) <= 0)
+        return false;
+    char c;
+    if (read(fd, &c, 1) != 1)
+        return false;
+    if (c == 0x03)
+        return true;
+    input += c;
+    return false;
+}
+
+void GdbStub::detach() {
+    program.breakpoints.clear();
+    program.removeBreakpoints();
+    watchpoints.clear();
+    updateWatches();
+    while (!program.isEnd)
+        program.step();
+}
+
+void GdbStub::updateWatches() {
+    program.memory.clearFlags(SEG_WATCHED);
+    for (auto &watchpoint: watchpoints)
+        program.memory.setFlags(watchpoint.first, watchpoint.second, SEG_WATCHED);
+}
+
+uint32_t GdbStub::readRegister(int reg) {
+    return reg < 16 ? program.gpr_registers[reg] : program.csr_registers[reg - 16];
+}
+
+void GdbStub::writeRegister(int reg, uint32_t value) {
+    if (reg < 16)
+        program.gpr_registers[reg] = (int32_t) value;
+    else
+        program.csr_registers[reg - 16] = (int32_t) value;
+    if (reg == REG_PC)
+        program.currInstr.value = program.memory.readWord(program.PC());
+}
+
+std::string GdbStub::readMemory(uint32_t addr, uint32_t len) {
+    std::string reply;
+    char byte[3];
+    for (uint32_t i = 0; i < len; ++i) {
+        auto word = (uint32_t) program.memory.readWord((addr + i) & ~3u);
+        std::snprintf(byte, sizeof(byte), "%02x", (word >> (8 * ((addr + i) & 3))) & 0xff);
+        reply += byte;
+    }
+    return reply;
+}
+
+void GdbStub::writeMemory(uint32_t addr, const std::string &data) {
+    // all bytes are parsed first, a malformed packet changes nothing
+    std::vector<uint32_t> bytes;
+    for (size_t i = 0; i + 1 < data.size(); i += 2)
+        bytes.push_back(std::stoul(data.substr(i, 2), nullptr, 16));
+    for (size_t i = 0; i < bytes.size(); ++i) {
+        auto target = addr + (uint32_t) i;
+        auto shift = 8 * (target & 3);
+        auto word = (uint32_t) program.memory.readWord(target & ~3u);
+        word = (word & ~(0xffu << shift)) | (bytes[i] << shift);
+        program.memory.writeWord(target & ~3u, word);
+    }
+    // the stop state belongs to the debugger, not to the guest
+    watchTriggered = false;
+    program.currInstr.value = program.memory.readWord(program.PC());
+}
+
+std::string GdbStub::targetXml() {
+    std::ostringstream xml;
+    xml << "<?xml version=\"1.0\"?><!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+        << "<target version=\"1.0\"><feature name=\"org.emulator.core\">";
+    for (int i = 0; i < 14; ++i)
+        xml << "<reg name=\"r" << i << "\" bitsize=\"32\" type=\"uint32\"/>";
+    xml << "<reg name=\"sp\" bitsize=\"32\" type=\"data_ptr\"/>"
+        << "<reg name=\"pc\" bitsize=\"32\" type=\"code_ptr\"/>"
+        << "<reg name=\"status\" bitsize=\"32\" type=\"uint32\"/>"
+        << "<reg name=\"handler\" bitsize=\"32\" type=\"code_ptr\"/>"
+        << "<reg name=\"cause\" bitsize=\"32\" type=\"uint32\"/>"
+        << "</feature></target>";
+    return xml.str();
+}
+
+std::string GdbStub::hexWord(uint32_t value) {
+    // target byte order
+    char hex[9];
+    std::snprintf(hex, sizeof(hex), "%02x%02x%02x%02x",
+                  value & 0xff, (value >> 8) & 0xff, (value >> 16) & 0xff, value >> 24);
+    return hex;
+}
+
+std::string GdbStub::hexValue(uint32_t value) {
+    char hex[9];
+    std::snprintf(hex, sizeof(hex), "%x", value);
+    return hex;
+}
+
+uint32_t GdbStub::parseWord(const std::string &hex) {
+    uint32_t value = 0;
+    for (size_t i = 0; i + 1 < hex.size() && i < 8; i += 2)
+        value |= std::stoul(hex.substr(i, 2), nullptr, 16) << (4 * i);
+    return value;
+}
@@ -0,0 +1,103 @@
+#include "../include/lockstep.h"
+#include "../include/symbol_map.h"
+#include "../../common/include/program.h"
+
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+
+Lockstep::Lockstep(Program &reference, std::unique_ptr<Engine> candidate)
+        : reference(reference), candidate(std::move(candidate)) {
+    if (reference.devices)
+        throw std::runtime_error("Lockstep runs without devices");
+    // the copy starts from the same state, through the snapshot format
+    std::stringstream state;
+    reference.saveState(state);
+    // the copy keeps no log of its own
+    copy = std::make_unique<Program>("");
+    copy->restoreState(state);
+    copy->trace = false;
+    reference.addObserver(&referenceWrites);
+    copy->initNew();
+    reference.memory.takeDirty();
+    copy->memory.takeDirty();
+}
+
+void Lockstep::run() {
+    while (!reference.isEnd) {
+        auto blockPc = (uint32_t) reference.PC();
+        referenceWrites.writes.clear();
+        std::string candidateFault;
+        try {
+            candidate->runBlock(*copy);
+        } catch (std::runtime_error &error) {
+            candidateFault = error.what();
+        }
+        try {
+            while (!reference.isEnd && reference.instrCounter < copy->instrCounter)
+                reference.step();
+        } catch (std::runtime_error &error) {
+            if (candidateFault != error.what() || reference.instrCounter != copy->instrCounter)
+                diverged(std::string("reference fault: ") + error.what(), blockPc);
+            // both fault on the same instruction
+            throw;
+        }
+        referenceSegments = reference.memory.takeDirty();
+        candidateSegments = copy->memory.takeDirty();
+        std::sort(referenceSegments.begin(), referenceSegments.end());
+        std::sort(candidateSegments.begin(), candidateSegments.end());
+        if (!candidateFault.empty())
+            diverged("candidate fault: " + candidateFault, blockPc);
+        compare(blockPc);
+        ++blocks;
+    }
+    std::cerr << "Lockstep: " << blocks << " blocks, " << reference.instrCounter << " instructions, "
+              << candidate->name() << " matches the reference" << '\n';
+}
+
+void Lockstep::compare(uint32_t blockPc) {
+    if (reference.isEnd != copy->isEnd)
+        return diverged("halt", blockPc);
+    if (reference.instrCounter != copy->instrCounter)
+        return diverged("retired instructions", blockPc);
+    if (reference.gpr_registers != copy->gpr_registers)
+        return diverged("general purpose registers", blockPc);
+    if (reference.csr_registers != copy->csr_registers)
+        return diverged("control and status registers", blockPc);
+    if (reference.psw.val != copy->psw.val)
+        return diverged("psw", blockPc);
+    if (referenceSegments != candidateSegments)
+        return diverged("written segments", blockPc);
+    auto segmentSize = reference.memory._segmentSize;
+    for (auto index: referenceSegments) {
+        auto &expected = reference.memory.getSegment(index).data;
+        auto &actual = copy->memory.getSegment(index).data;
+        auto mismatch = std::mismatch(expected.begin(), expected.end(), actual.begin());
+        if (mismatch.first != expected.end())
+            return diverged("memory at " + SymbolMap::hexAddr(
+                    index * segmentSize + (uint32_t) (mismatch.first - expected.begin())), blockPc);
+    }
+}
+
+void Lockstep::diverged(const std::string &what, uint32_t blockPc) {
+    std::cerr << "Lockstep divergence in " << what << ", block at " << SymbolMap::hexAddr(blockPc)
+              << " after " << blocks << " blocks" << '\n';
+    std::cerr << "--- reference" << '\n';
+    dump(std::cerr, reference, referenceWrites.writes);
+    std::cerr << "--- " << candidate->name() << '\n';
+    dump(std::cerr, *copy, referenceWrites.writes);
+    throw std::runtime_error("Lockstep divergence in " + what);
+}
+
+void Lockstep::dump(std::ostream &out, Program &program, const std::vector<uint32_t> &writes) {
+    out << "instructions " << program.instrCounter << (program.isEnd ? " halted" : "") << '\n';
+    for (int i = 0; i < 16; ++i)
+        out << "r" << std::left << std::setw(2) << std::dec << i << ' ' << SymbolMap::hexAddr(program.gpr_registers[i])
+            << ((i % 4 == 3) ? '\n' : ' ');
+    out << "status " << SymbolMap::hexAddr(program.STATUS()) << " handler " << SymbolMap::hexAddr(program.HANDLER())
+        << " cause " << SymbolMap::hexAddr(program.CAUSE()) << " psw " << SymbolMap::hexAddr(program.psw.val) << '\n';
+    // the words the reference wrote, as each machine holds them
+    for (auto addr: writes)
+        out << "write " << SymbolMap::hexAddr(addr) << " = " << SymbolMap::hexAddr(program.memory.readWord(addr)) << '\n';
+}
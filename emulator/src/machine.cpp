@@ -0,0 +1,128 @@
+#include "../include/machine.h"
+#include "../include/emulator.h"
+#include "../include/block_device.h"
+#include "../include/semihost.h"
+#include "../../common/include/program.h"
+
+#include <sstream>
+
+Machine::Machine(const std::string &logFile)
+        : _program(std::make_unique<Program>(logFile)), _semihost(std::make_unique<Semihost>()) {
+    if (logFile.empty())
+        _program->disableTrace();
+    _program->devices = true;
+    _program->timerPeriod = std::chrono::nanoseconds(0);
+    _program->output = [](int32_t) {};
+    _semihost->output = [](const char *, size_t) {};
+}
+
+Machine::~Machine() = default;
+
+void Machine::start() {
+    // the current instruction is fetched ahead, anything that may have changed it fetches it again
+    if (!started) {
+        _program->lastTimerExecution = std::chrono::system_clock::now();
+        _program->initNew();
+        started = true;
+    } else
+        _program->loadInstr();
+    stale = false;
+}
+
+void Machine::loadImage(const std::string &file) {
+    _program->load(file);
+    stale = true;
+}
+
+void Machine::loadImage(const void *data, size_t size) {
+    std::istringstream image(std::string(static_cast<const char *>(data), size));
+    _program->load(image);
+    if (!image)
+        throw std::runtime_error("Image is truncated");
+    stale = true;
+}
+
+uint64_t Machine::run(uint64_t maxInstructions) {
+    if (!started || stale)
+        start();
+    auto begin = _program->instrCounter;
+    while (!_program->isEnd && _program->instrCounter - begin < maxInstructions)
+        _program->step();
+    return _program->instrCounter - begin;
+}
+
+bool Machine::halted() const {
+    return _program->isEnd;
+}
+
+uint64_t Machine::instructions() const {
+    return _program->instrCounter;
+}
+
+int32_t Machine::reg(uint8_t index) const {
+    return _program->gpr_registers.at(index);
+}
+
+void Machine::setReg(uint8_t index, int32_t value) {
+    _program->gpr_registers.at(index) = value;
+    if (index == REG_PC)
+        stale = true;
+}
+
+int32_t Machine::csr(uint8_t index) const {
+    return _program->csr_registers.at(index);
+}
+
+void Machine::setCsr(uint8_t index, int32_t value) {
+    _program->csr_registers.at(index) = value;
+}
+
+int32_t Machine::readWord(uint32_t addr) {
+    return _program->memory.readWord(addr);
+}
+
+void Machine::writeWord(uint32_t addr, int32_t value) {
+    _program->memory.writeWord(addr, value);
+    stale = true;
+}
+
+void Machine::onOutput(std::function<void(int32_t)> callback) {
+    _program->output = std::move(callback);
+}
+
+void Machine::enableSemihost() {
+    _program->semihost = _semihost.get();
+}
+
+void Machine::onHostOutput(std::function<void(const char *, size_t)> callback) {
+    _semihost->output = std::move(callback);
+}
+
+int32_t Machine::exitStatus() const {
+    return _program->exitStatus;
+}
+
+bool Machine::pressKey(char key) {
+    if (_program->keyBarrier)
+        return false;
+    _program->keyboardBuf = key;
+    _program->keyBarrier = true;
+    return true;
+}
+
+void Machine::setTimerPeriod(std::chrono::nanoseconds period) {
+    _program->timerPeriod = period;
+}
+
+void Machine::addObserver(Observer *observer) {
+    _program->addObserver(observer);
+}
+
+void Machine::attachDisk(const std::string &file) {
+    _disk = std::make_unique<BlockDevice>(file);
+    _program->attachDisk(_disk.get());
+}
+
+Program &Machine::program() {
+    return *_program;
+}
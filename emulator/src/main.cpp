@@ -2,9 +2,7 @@
 
 int main(int argc, char *argv[]) {
 
-    auto &emulator = Emulator::singleton();
+    Emulator emulator;
     emulator.parseArgs(argc, argv);
-    emulator.execute();
-
-    return 0;
+    return emulator.execute();
 }
@@ -0,0 +1,182 @@
+#include "../include/memory_dump.h"
+#include "../include/symbol_map.h"
+#include "../../common/include/program.h"
+
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    template<typename T>
+    void put(std::ostream &out, const T &value) {
+        out.write(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+
+    template<typename T>
+    void get(std::istream &in, T &value) {
+        in.read(reinterpret_cast<char *>(&value), sizeof(value));
+    }
+
+    std::string hexWord(int32_t value) {
+        return SymbolMap::hexAddr((uint32_t) value);
+    }
+}
+
+void MemoryDump::write(Program &program, const std::string &file) {
+    std::ofstream out(file, std::ios::binary);
+    if (!out)
+        throw std::runtime_error("Failed to open file: " + file);
+    auto &memory = program.memory;
+    auto indexes = memory.writtenSegments();
+    put(out, (uint32_t) DUMP_MAGIC);
+    put(out, memory._segmentSize);
+    put(out, (uint32_t) program.gpr_registers.size());
+    out.write(reinterpret_cast<const char *>(program.gpr_registers.data()), program.gpr_registers.size() * sizeof(int32_t));
+    put(out, (uint32_t) program.csr_registers.size());
+    out.write(reinterpret_cast<const char *>(program.csr_registers.data()), program.csr_registers.size() * sizeof(int32_t));
+    put(out, (uint32_t) indexes.size());
+    for (auto index: indexes)
+        put(out, (uint32_t) (memory._minAddr + (uint64_t) index * memory._segmentSize));
+    for (auto index: indexes)
+        out.write(reinterpret_cast<const char *>(memory.getSegment(index).data.data()), memory._segmentSize);
+    out.close();
+}
+
+void MemoryDump::load(const std::string &file) {
+    std::ifstream in(file, std::ios::binary);
+    if (!in.is_open())
+        throw std::runtime_error("Could not open file " + file);
+    in.seekg(0, std::ios::end);
+    auto size = (uint64_t) in.tellg();
+    in.seekg(0);
+    uint32_t magic = 0;
+    get(in, magic);
+    if (!in || magic != DUMP_MAGIC)
+        throw std::runtime_error("Not a memory dump " + file);
+    get(in, segmentSize);
+    if (!in || segmentSize == 0)
+        throw std::runtime_error("Bad segment size in memory dump " + file);
+    // every count is checked against what is left of the file before anything is resized
+    auto count = [&](uint64_t elementSize) {
+        uint32_t value = 0;
+        get(in, value);
+        if (!in || value * elementSize > size - (uint64_t) in.tellg())
+            throw std::runtime_error("Truncated memory dump " + file);
+        return value;
+    };
+    gpr.resize(count(sizeof(int32_t)));
+    in.read(reinterpret_cast<char *>(gpr.data()), gpr.size() * sizeof(int32_t));
+    csr.resize(count(sizeof(int32_t)));
+    in.read(reinterpret_cast<char *>(csr.data()), csr.size() * sizeof(int32_t));
+    addresses.resize(count(sizeof(uint32_t) + segmentSize));
+    in.read(reinterpret_cast<char *>(addresses.data()), addresses.size() * sizeof(uint32_t));
+    bytes.resize(addresses.size() * segmentSize);
+    in.read(reinterpret_cast<char *>(bytes.data()), bytes.size());
+    if (!in)
+        throw std::runtime_error("Truncated memory dump " + file);
+    if (!std::is_sorted(addresses.begin(), addresses.end()))
+        throw std::runtime_error("Unsorted segment index in memory dump " + file);
+}
+
+bool MemoryDump::readWord(uint32_t addr, int32_t &value) const {
+    // a word may straddle two written segments, every byte has to be found
+    uint8_t word[4];
+    for (uint32_t i = 0; i < 4; ++i) {
+        auto byte = addr + i;
+        auto it = std::upper_bound(addresses.begin(), addresses.end(), byte);
+        if (it == addresses.begin() || byte - *(it - 1) >= segmentSize)
+            return false;
+        word[i] = bytes[(size_t) (it - 1 - addresses.begin()) * segmentSize + byte - *(it - 1)];
+    }
+    std::memcpy(&value, word, sizeof(value));
+    return true;
+}
+
+size_t MemoryDump::diff(const MemoryDump &a, const MemoryDump &b, std::ostream &out) {
+    if (a.segmentSize != b.segmentSize)
+        throw std::runtime_error("Memory dumps with different segment sizes");
+    size_t differences = 0;
+    auto report = [&](const std::string &line) {
+        if (differences++ < DUMP_DIFF_LINES)
+            out << line << '\n';
+    };
+    for (size_t i = 0; i < std::max(a.gpr.size(), b.gpr.size()); ++i)
+        if (i >= a.gpr.size() || i >= b.gpr.size() || a.gpr[i] != b.gpr[i])
+            report("%r" + std::to_string(i) + ": " + (i < a.gpr.size() ? hexWord(a.gpr[i]) : "-") + " "
+                   + (i < b.gpr.size() ? hexWord(b.gpr[i]) : "-"));
+    for (size_t i = 0; i < std::max(a.csr.size(), b.csr.size()); ++i)
+        if (i >= a.csr.size() || i >= b.csr.size() || a.csr[i] != b.csr[i])
+            report("csr" + std::to_string(i) + ": " + (i < a.csr.size() ? hexWord(a.csr[i]) : "-") + " "
+                   + (i < b.csr.size() ? hexWord(b.csr[i]) : "-"));
+    // both indexes are sorted, segments written by only one run are not compared word by word
+    size_t i = 0, j = 0;
+    while (i < a.addresses.size() || j < b.addresses.size()) {
+        if (j == b.addresses.size() || (i < a.addresses.size() && a.addresses[i] < b.addresses[j])) {
+            report(SymbolMap::hexAddr(a.addresses[i++]) + ": segment written only in the first dump");
+            continue;
+        }
+        if (i == a.addresses.size() || b.addresses[j] < a.addresses[i]) {
+            report(SymbolMap::hexAddr(b.addresses[j++]) + ": segment written only in the second dump");
+            continue;
+        }
+        auto *first = a.bytes.data() + i * a.segmentSize;
+        auto *second = b.bytes.data() + j * b.segmentSize;
+        if (std::memcmp(first, second, a.segmentSize) != 0)
+            for (uint32_t offset = 0; offset + 4 <= a.segmentSize; offset += 4) {
+                int32_t x, y;
+                std::memcpy(&x, first + offset, 4);
+                std::memcpy(&y, second + offset, 4);
+                if (x != y)
+                    report(SymbolMap::hexAddr(a.addresses[i] + offset) + ": " + hexWord(x) + " " + hexWord(y));
+            }
+        ++i;
+        ++j;
+    }
+    if (differences > DUMP_DIFF_LINES)
+        out << "... " << differences - DUMP_DIFF_LINES << " more" << '\n';
+    return differences;
+}
+
+size_t MemoryDump::check(const std::string &file, const SymbolMap &symbols, std::ostream &out) const {
+    std::ifstream in(file);
+    if (!in.is_open())
+        throw std::runtime_error("Could not open file " + file);
+    size_t failures = 0;
+    std::string line;
+    while (std::getline(in, line)) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream iss(line);
+        std::string location, expectedText;
+        if (!(iss >> location))
+            continue;
+        if (!(iss >> expectedText))
+            throw std::runtime_error("No expected value for " + location + " in " + file);
+        auto expected = (int32_t) std::stoll(expectedText, nullptr, 0);
+        int32_t actual;
+        bool found = true;
+        if (location == "%sp" || location == "%pc")
+            actual = gpr.at(location == "%sp" ? REG_SP : REG_PC);
+        else if (location.rfind("%r", 0) == 0)
+            actual = gpr.at(std::stoul(location.substr(2)));
+        else {
+            auto plus = location.find('+');
+            auto base = location.substr(0, plus);
+            uint32_t addr;
+            if (!symbols.symbolAddr(base, addr))
+                addr = std::stoul(base, nullptr, 16);
+            if (plus != std::string::npos)
+                addr += std::stoul(location.substr(plus + 1), nullptr, 0);
+            found = readWord(addr, actual);
+        }
+        if (!found) {
+            // the dump holds only the segments the run wrote, not the ones the loader filled from the image
+            out << location << ": expected " << hexWord(expected) << ", not written during the run" << '\n';
+            ++failures;
+        } else if (actual != expected) {
+            out << location << ": expected " << hexWord(expected) << ", got " << hexWord(actual) << '\n';
+            ++failures;
+        }
+    }
+    return failures;
+}
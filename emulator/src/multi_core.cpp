@@ -0,0 +1,69 @@
+#include "../include/multi_core.h"
+#include "../include/emulator.h"
+#include "../../common/include/program.h"
+#include "../../common/include/log.h"
+
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+MultiCore::MultiCore(Program &boot, unsigned count, bool trace) : boot(boot) {
+    if (count < 1 || count > MAX_CORES)
+        throw std::runtime_error("Core count must be between 1 and " + std::to_string(MAX_CORES));
+    boot.memory.concurrent = true;
+    boot.multiCore = true;
+    for (unsigned id = 1; id < count; ++id) {
+        // one log per core, interleaved lines of several cores would be unreadable
+        auto core = std::make_unique<Program>(trace ? "log" + std::to_string(id) + ".txt" : "", &boot.memory);
+        if (!trace)
+            core->disableTrace();
+        core->PC() = boot.PC();
+        core->SP() = boot.SP() - (int32_t) (id * CORE_STACK_SIZE);
+        core->COREID() = (int32_t) id;
+        core->multiCore = true;
+        core->initNew();
+        secondaries.push_back(std::move(core));
+    }
+}
+
+MultiCore::~MultiCore() {
+    boot.memory.concurrent = false;
+}
+
+void MultiCore::run() {
+    std::atomic<bool> stop{false};
+    std::mutex errorMutex;
+    std::string error;
+    auto runCore = [&](Program &core) {
+        try {
+            while (!core.isEnd && !stop)
+                core.step();
+        } catch (std::exception &fault) {
+            std::lock_guard<std::mutex> lock(errorMutex);
+            if (error.empty())
+                error = "Core " + std::to_string(core.COREID()) + ": " + fault.what();
+            stop = true;
+        }
+    };
+    std::vector<std::thread> threads;
+    for (auto &core: secondaries)
+        threads.emplace_back(runCore, std::ref(*core));
+    runCore(boot);
+    for (auto &thread: threads)
+        thread.join();
+    report(std::cout);
+    if (!error.empty())
+        throw std::runtime_error(error);
+}
+
+void MultiCore::report(std::ostream &out) const {
+    Log::tableName(out, "Cores");
+    out << std::left << std::dec;
+    out << std::setw(25) << "Core 0" << boot.instrCounter << (boot.isEnd ? "" : " (stopped)") << "\n";
+    for (auto &core: secondaries)
+        out << std::setw(25) << "Core " + std::to_string(core->COREID()) << core->instrCounter
+            << (core->isEnd ? "" : " (stopped)") << "\n";
+    Log::tableFooter(out);
+}
@@ -0,0 +1,117 @@
+#include "../include/semihost.h"
+#include "../../common/include/memory.h"
+
+#include <iostream>
+#include <string>
+
+namespace {
+    constexpr uint32_t CHUNK_SIZE = 64 * 1024;
+}
+
+Semihost::Semihost() : output([](const char *bytes, size_t length) { std::cout.write(bytes, length).flush(); }) {}
+
+std::fstream *Semihost::file(int32_t handle) {
+    auto index = handle - SEMI_FIRST_HANDLE;
+    if (index < 0 || index >= (int32_t) files.size())
+        return nullptr;
+    return files[index].get();
+}
+
+int32_t Semihost::call(Memory &memory, int32_t op, int32_t arg0, int32_t arg1, int32_t arg2) {
+    switch (op) {
+        case SEMI_WRITE:
+            return write(memory, arg0, arg1, arg2);
+        case SEMI_OPEN:
+            return open(memory, arg0, arg1);
+        case SEMI_READ:
+            return read(memory, arg0, arg1, arg2);
+        case SEMI_CLOSE:
+            return close(arg0);
+        case SEMI_TIME:
+            return (int32_t) std::chrono::duration_cast<std::chrono::seconds>(
+                    std::chrono::system_clock::now().time_since_epoch()).count();
+        case SEMI_CLOCK:
+            return (int32_t) std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - start).count();
+        default:
+            return -1;
+    }
+}
+
+int32_t Semihost::write(Memory &memory, int32_t handle, uint32_t buffer, uint32_t length) {
+    auto *out = handle > 2 ? file(handle) : nullptr;
+    if (handle != 1 && handle != 2 && !out)
+        return -1;
+    std::vector<char> chunk(std::min(length, CHUNK_SIZE));
+    for (uint32_t done = 0; done < length;) {
+        auto size = std::min(CHUNK_SIZE, length - done);
+        memory.readBytes(buffer + done, reinterpret_cast<uint8_t *>(chunk.data()), size);
+        if (handle == 1)
+            output(chunk.data(), size);
+        else if (handle == 2)
+            std::cerr.write(chunk.data(), size);
+        else if (!out->write(chunk.data(), size))
+            return -1;
+        done += size;
+    }
+    return (int32_t) length;
+}
+
+int32_t Semihost::open(Memory &memory, uint32_t path, int32_t mode) {
+    std::string name;
+    for (uint8_t c; name.size() < SEMI_PATH_MAX; name.push_back((char) c)) {
+        memory.readBytes(path + name.size(), &c, 1);
+        if (!c)
+            break;
+    }
+    std::ios::openmode flags = std::ios::binary;
+    switch (mode) {
+        case SEMI_MODE_READ:
+            flags |= std::ios::in;
+            break;
+        case SEMI_MODE_WRITE:
+            flags |= std::ios::out | std::ios::trunc;
+            break;
+        case SEMI_MODE_APPEND:
+            flags |= std::ios::out | std::ios::app;
+            break;
+        default:
+            return -1;
+    }
+    auto stream = std::make_unique<std::fstream>(name, flags);
+    if (!stream->is_open())
+        return -1;
+    // closed handles are reused
+    size_t index = 0;
+    while (index < files.size() && files[index])
+        ++index;
+    if (index == files.size())
+        files.emplace_back();
+    files[index] = std::move(stream);
+    return (int32_t) index + SEMI_FIRST_HANDLE;
+}
+
+int32_t Semihost::read(Memory &memory, int32_t handle, uint32_t buffer, uint32_t length) {
+    auto *in = file(handle);
+    if (!in)
+        return -1;
+    std::vector<char> chunk(std::min(length, CHUNK_SIZE));
+    uint32_t done = 0;
+    while (done < length) {
+        in->read(chunk.data(), std::min(CHUNK_SIZE, length - done));
+        auto size = (uint32_t) in->gcount();
+        memory.writeBytes(buffer + done, reinterpret_cast<const uint8_t *>(chunk.data()), size);
+        done += size;
+        if (!*in)
+            break;
+    }
+    in->clear();
+    return (int32_t) done;
+}
+
+int32_t Semihost::close(int32_t handle) {
+    if (!file(handle))
+        return -1;
+    files[handle - SEMI_FIRST_HANDLE].reset();
+    return 0;
+}
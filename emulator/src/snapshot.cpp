@@ -0,0 +1,33 @@
+#include "../include/snapshot.h"
+#include "../../common/include/program.h"
+
+#include <fstream>
+
+void SnapshotWriter::onExecute(Program &program) {
+    if (written)
+        return;
+    // currInstr has not been executed yet, it is the first one executed after a resume
+    auto retired = program.instrCounter - 1;
+    if ((atPc && (uint32_t) program.PC() == atPc) || (afterInstructions && retired == afterInstructions)) {
+        --program.instrCounter;
+        save(program, outputFile);
+        ++program.instrCounter;
+        written = true;
+    }
+}
+
+void SnapshotWriter::save(Program &program, const std::string &file) {
+    std::ofstream out(file, std::ios::binary);
+    if (!out)
+        throw std::runtime_error("Failed to open file: " + file);
+    program.saveState(out);
+    out.close();
+}
+
+void SnapshotWriter::restore(Program &program, const std::string &file) {
+    std::ifstream in(file, std::ios::binary);
+    if (!in.is_open())
+        throw std::runtime_error("Could not open file " + file);
+    program.restoreState(in);
+    in.close();
+}
@@ -0,0 +1,77 @@
+#include "../include/stack_tracker.h"
+#include "../../common/include/log.h"
+#include "../../common/include/program.h"
+
+#include <iomanip>
+#include <sstream>
+#include <iostream>
+
+void StackUsage::update(uint32_t sp, uint32_t entrySp) {
+    if (sp < minSp)
+        minSp = sp;
+    if (sp < entrySp && entrySp - sp > maxDepth)
+        maxDepth = entrySp - sp;
+}
+
+void StackTracker::checkGuard(uint32_t sp) {
+    if (!guardAddr)
+        return;
+    // only the %sp the loader set up may sit below the guard, checked from the first %sp the guest sets
+    if (!guardArmed) {
+        if (sp == frames.front().sp)
+            return;
+        guardArmed = true;
+    }
+    if (sp < guardAddr)
+        throw std::runtime_error("Stack guard " + SymbolMap::hexAddr(guardAddr) + " crossed by "
+                                 + symbolMap.symbolName(lastPc) + ", %sp=" + SymbolMap::hexAddr(sp));
+}
+
+void StackTracker::onExecute(Program &program) {
+    CallStack::onExecute(program);
+    auto sp = (uint32_t) program.SP();
+    checkGuard(sp);
+    lastPc = program.PC();
+
+    overall.update(sp, frames.front().sp);
+    // a handler entered outside of any call is charged to the entry routine, like one entered inside a call
+    auto &topLevel = frames.size() > 1 && !frames[1].node->interrupt ? frames[1] : frames[0];
+    routines[topLevel.node->routine].update(sp, topLevel.sp);
+    auto &frame = frames.back();
+    if (frame.cause)
+        causes[frame.cause].update(sp, frames[frame.interruptFrame].sp);
+}
+
+void StackTracker::onWrite(Program &program, uint32_t addr) {
+    if (addr == (uint32_t) program.SP())
+        checkGuard(addr);
+}
+
+void StackTracker::log(std::ostream &out) const {
+    Log::tableName(out, "Stack usage");
+    out << std::left
+        << std::setw(30) << "Routine"
+        << std::setw(15) << "Min SP"
+        << std::setw(15) << "Max depth"
+        << "\n";
+    auto row = [&out](const std::string &name, const StackUsage &usage) {
+        out << std::left
+            << std::setw(30) << name
+            << std::setw(15) << SymbolMap::hexAddr(usage.minSp)
+            << std::setw(15) << std::dec << usage.maxDepth
+            << "\n";
+    };
+    row("(overall)", overall);
+    for (auto &routine: routines)
+        row(symbolMap.symbolName(routine.first), routine.second);
+    for (auto &cause: causes) {
+        std::ostringstream name;
+        name << "int:" << (enum STATUS) cause.first;
+        row(name.str(), cause.second);
+    }
+    Log::tableFooter(out);
+}
+
+void StackTracker::onExit(Program &) {
+    log(std::cerr);
+}
@@ -0,0 +1,179 @@
+#include "../include/statistics.h"
+#include "../include/fork_point.h"
+#include "../../common/include/log.h"
+#include "../../common/include/program.h"
+
+#include <iomanip>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+
+volatile std::sig_atomic_t Statistics::dumpRequested = 0;
+
+Statistics::Statistics(std::string jsonFile) : jsonFile(std::move(jsonFile)) {
+    std::signal(SIGUSR1, onSignal);
+}
+
+void Statistics::onSignal(int) {
+    dumpRequested = 1;
+}
+
+void Statistics::onExecute(Program &program) {
+    ++opcodes[program.currInstr.byte_0];
+    // the stack accesses of this instruction reach onRead and onWrite as pops and pushes, not loads and stores
+    pendingPushes = pendingPops = 0;
+    switch (program.currInstr.byte_0) {
+        case CALL:
+        case CALL_MEM:
+            pendingPushes = 1;
+            break;
+        case ST_POST_INC:
+            pendingPushes = program.currInstr.REG_A == REG_SP;
+            break;
+        case LD_POST_INC:
+        case CSR_LD_POST_INC:
+            pendingPops = program.currInstr.REG_B == REG_SP;
+            break;
+        case CSR_LD_IND:
+            // iret reads the pushed status above the return address before popping both
+            pendingPops = program.currInstr.REG_A == CSR_STATUS && program.currInstr.REG_B == REG_SP;
+            break;
+        default:
+            break;
+    }
+    if (dumpRequested) {
+        dumpRequested = 0;
+        log(std::cerr, program);
+    }
+}
+
+void Statistics::onBranch(Program &program) {
+    auto opcode = program.currInstr.byte_0;
+    if (opcode == JMP || opcode == JMP_MEM)
+        ++jumps;
+    else
+        ++branches;
+}
+
+void Statistics::onInterrupt(Program &, uint32_t cause, uint32_t) {
+    // int and hardware interrupts both push status and the return address, already counted as stores
+    stores -= 2;
+    pushes += 2;
+    ++interrupts[cause];
+}
+
+void Statistics::onFetch(Program &, uint32_t) {
+    ++fetches;
+}
+
+void Statistics::onRead(Program &, uint32_t) {
+    if (pendingPops) {
+        --pendingPops;
+        ++pops;
+    } else
+        ++loads;
+}
+
+void Statistics::onWrite(Program &, uint32_t) {
+    if (pendingPushes) {
+        --pendingPushes;
+        ++pushes;
+    } else
+        ++stores;
+}
+
+double Statistics::elapsedSeconds(const Program &program) {
+    std::chrono::duration<double> elapsed = std::chrono::system_clock::now() - program.executionStart;
+    return elapsed.count();
+}
+
+std::string Statistics::opcodeName(uint32_t opcode) {
+    std::ostringstream name;
+    try {
+        name << (enum INSTRUCTION) opcode;
+    } catch (std::runtime_error &) {
+        name.str("");
+        name << "0x" << std::hex << opcode;
+    }
+    return name.str();
+}
+
+void Statistics::log(std::ostream &out, const Program &program) const {
+    auto seconds = elapsedSeconds(program);
+    Log::tableName(out, "Statistics");
+    out << std::left << std::dec
+        << std::setw(25) << "Instructions" << program.instrCounter << "\n"
+        << std::setw(25) << "Wall time [s]" << std::fixed << std::setprecision(3) << seconds << "\n"
+        << std::setw(25) << "MIPS" << (double) program.instrCounter / seconds / 1e6 << "\n"
+        << std::setw(25) << "Fetches" << fetches << "\n"
+        << std::setw(25) << "Loads" << loads << "\n"
+        << std::setw(25) << "Stores" << stores << "\n"
+        << std::setw(25) << "Pushes" << pushes << "\n"
+        << std::setw(25) << "Pops" << pops << "\n"
+        << std::setw(25) << "Taken branches" << branches << "\n"
+        << std::setw(25) << "Jumps" << jumps << "\n"
+        << std::setw(25) << "Segments allocated" << program.memory._segments.size() << "\n"
+        << std::setw(25) << "Memory backing" << program.memory.backingName() << "\n";
+    for (auto &interrupt: interrupts) {
+        std::ostringstream name;
+        name << "Interrupts " << (enum STATUS) interrupt.first;
+        out << std::setw(25) << name.str() << interrupt.second << "\n";
+    }
+    Log::tableFooter(out);
+
+    Log::tableName(out, "Instruction mix");
+    for (uint32_t opcode = 0; opcode < 256; ++opcode)
+        if (opcodes[opcode])
+            out << std::setw(25) << opcodeName(opcode) << std::setw(15) << opcodes[opcode]
+                << std::setprecision(2) << 100.0 * (double) opcodes[opcode] / (double) program.instrCounter
+                << "%\n";
+    Log::tableFooter(out);
+}
+
+void Statistics::writeJson(std::ostream &out, const Program &program) const {
+    auto seconds = elapsedSeconds(program);
+    out << "{\n"
+        << "  \"instructions\": " << program.instrCounter << ",\n"
+        << "  \"wall_seconds\": " << seconds << ",\n"
+        << "  \"mips\": " << (double) program.instrCounter / seconds / 1e6 << ",\n"
+        << "  \"fetches\": " << fetches << ",\n"
+        << "  \"loads\": " << loads << ",\n"
+        << "  \"stores\": " << stores << ",\n"
+        << "  \"pushes\": " << pushes << ",\n"
+        << "  \"pops\": " << pops << ",\n"
+        << "  \"taken_branches\": " << branches << ",\n"
+        << "  \"jumps\": " << jumps << ",\n"
+        << "  \"segments_allocated\": " << program.memory._segments.size() << ",\n"
+        << "  \"memory_backing\": \"" << program.memory.backingName() << "\",\n"
+        << "  \"interrupts\": {";
+    auto first = true;
+    for (auto &interrupt: interrupts) {
+        out << (first ? "" : ",") << "\n    \"" << (enum STATUS) interrupt.first << "\": " << interrupt.second;
+        first = false;
+    }
+    out << (first ? "" : "\n  ") << "},\n"
+        << "  \"opcodes\": {";
+    first = true;
+    for (uint32_t opcode = 0; opcode < 256; ++opcode)
+        if (opcodes[opcode]) {
+            out << (first ? "" : ",") << "\n    \"" << opcodeName(opcode) << "\": " << opcodes[opcode];
+            first = false;
+        }
+    out << (first ? "" : "\n  ") << "}\n"
+        << "}\n";
+}
+
+void Statistics::onExit(Program &program) {
+    log(std::cerr, program);
+    if (jsonFile.empty())
+        return;
+    std::ofstream out(jsonFile);
+    if (!out)
+        throw std::runtime_error("Failed to open file: " + jsonFile);
+    writeJson(out, program);
+    out.close();
+}
+
+void Statistics::onFork(Program &, const std::string &input) {
+    jsonFile = ForkPoint::childFile(input, jsonFile);
+}
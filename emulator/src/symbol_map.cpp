@@ -0,0 +1,85 @@
+#include "../include/symbol_map.h"
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+
+void SymbolMap::load(const std::string &mapFile) {
+    std::ifstream file(mapFile);
+    if (!file.is_open())
+        throw std::runtime_error("Could not open file " + mapFile);
+
+    std::string kind;
+    while (file >> kind) {
+        uint32_t addr;
+        if (kind == "section") {
+            MapSection section{};
+            file >> std::hex >> section.addr >> section.size >> section.name;
+            sections[section.addr] = section;
+        } else if (kind == "code") {
+            uint32_t size;
+            file >> std::hex >> addr >> size;
+            code[addr] = size;
+        } else if (kind == "symbol") {
+            std::string name;
+            file >> std::hex >> addr >> name;
+            // keep the first name listed for an address
+            symbols.emplace(addr, name);
+        } else
+            throw std::runtime_error("Invalid record " + kind + " in " + mapFile);
+    }
+    file.close();
+}
+
+bool SymbolMap::empty() const {
+    return symbols.empty() && sections.empty();
+}
+
+bool SymbolMap::symbolAddr(const std::string &name, uint32_t &addr) const {
+    for (auto &symbol: symbols)
+        if (symbol.second == name) {
+            addr = symbol.first;
+            return true;
+        }
+    return false;
+}
+
+std::string SymbolMap::hexAddr(uint32_t addr) {
+    std::ostringstream out;
+    out << "0x" << std::setfill('0') << std::setw(8) << std::hex << addr;
+    return out.str();
+}
+
+uint32_t SymbolMap::routineAddr(uint32_t addr) const {
+    auto it = symbols.upper_bound(addr);
+    if (it == symbols.begin())
+        return addr;
+    --it;
+    // do not name addresses past the section the symbol lives in
+    if (sectionName(it->first) != sectionName(addr))
+        return addr;
+    return it->first;
+}
+
+std::string SymbolMap::symbolName(uint32_t addr) const {
+    auto base = routineAddr(addr);
+    auto it = symbols.find(base);
+    if (it == symbols.end())
+        return hexAddr(addr);
+    if (base == addr)
+        return it->second;
+    std::ostringstream out;
+    out << it->second << "+0x" << std::hex << addr - base;
+    return out.str();
+}
+
+std::string SymbolMap::sectionName(uint32_t addr) const {
+    auto it = sections.upper_bound(addr);
+    if (it == sections.begin())
+        return "";
+    --it;
+    if (addr - it->second.addr >= it->second.size)
+        return "";
+    return it->second.name;
+}
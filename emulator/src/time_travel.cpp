@@ -0,0 +1,175 @@
+#include "../include/time_travel.h"
+#include "../include/event_log.h"
+#include "../../common/include/program.h"
+
+#include <iostream>
+#include <algorithm>
+
+namespace {
+    // Re-execution must not reach the other observers, the trace or the guest's output a second time.
+    class Muted {
+        Program &program;
+        std::vector<Observer *> observers;
+        std::vector<Observer *> memoryObservers;
+        bool trace;
+        std::ios::iostate logState;
+        std::ios::iostate outState;
+    public:
+        Muted(Program &program, Observer *watcher)
+                : program(program), trace(program.trace), logState(program.LOG->rdstate()),
+                  outState(std::cout.rdstate()) {
+            observers.swap(program.observers);
+            memoryObservers.swap(program.memoryObservers);
+            if (watcher)
+                program.memoryObservers.push_back(watcher);
+            program.trace = false;
+            program.LOG->setstate(std::ios::badbit);
+            std::cout.setstate(std::ios::badbit);
+        }
+
+        ~Muted() {
+            observers.swap(program.observers);
+            memoryObservers.swap(program.memoryObservers);
+            program.trace = trace;
+            program.LOG->clear(logState);
+            std::cout.clear(outState);
+        }
+    };
+}
+
+void TimeTravel::onExecute(Program &program) {
+    auto retired = program.instrCounter - 1;
+    if (checkpoints.empty() || retired >= checkpoints.back().retired + interval)
+        checkpoint(program, retired);
+}
+
+void TimeTravel::onWrite(Program &program, uint32_t addr) {
+    // only attached while searching, instrCounter is the writing instruction
+    for (auto &range: watchRanges)
+        if (addr < range.first + range.second && range.first < addr + 4) {
+            lastWrite = program.instrCounter;
+            lastWriteAddr = range.first;
+        }
+}
+
+void TimeTravel::checkpoint(Program &program, uint64_t retired) {
+    Checkpoint checkpoint{retired, program.gpr_registers, program.csr_registers, program.psw.val, {}};
+    auto dirty = program.memory.takeDirty();
+    if (checkpoints.empty()) {
+        // the base image holds every segment, later checkpoints only what changed
+        for (auto &segment: program.memory._segments)
+            checkpoint.segments[segment.first] = segment.second->data;
+    } else {
+        for (auto index: dirty) {
+            checkpoint.segments[index] = program.memory._segments.at(index)->data;
+            used += program.memory._segmentSize;
+        }
+    }
+    checkpoints.push_back(std::move(checkpoint));
+    while (used > budget && checkpoints.size() > 2)
+        mergeOldest();
+}
+
+void TimeTravel::mergeOldest() {
+    // the base moves forward, going back before it is no longer possible
+    auto &base = checkpoints[0];
+    auto &oldest = checkpoints[1];
+    for (auto &segment: oldest.segments) {
+        used -= segment.second.size();
+        base.segments[segment.first] = std::move(segment.second);
+    }
+    base.retired = oldest.retired;
+    base.gpr = std::move(oldest.gpr);
+    base.csr = std::move(oldest.csr);
+    base.psw = oldest.psw;
+    checkpoints.erase(checkpoints.begin() + 1);
+}
+
+size_t TimeTravel::nearest(uint64_t retired) const {
+    auto it = std::upper_bound(checkpoints.begin(), checkpoints.end(), retired,
+                               [](uint64_t value, const Checkpoint &checkpoint) {
+                                   return value < checkpoint.retired;
+                               });
+    if (it == checkpoints.begin())
+        throw std::runtime_error("No checkpoint before instruction " + std::to_string(retired));
+    return it - checkpoints.begin() - 1;
+}
+
+void TimeTravel::restore(Program &program, size_t idx) {
+    // only segments written after the checkpoint can differ from it
+    auto &memory = program.memory;
+    auto changed = memory._dirtySegments;
+    for (auto i = idx + 1; i < checkpoints.size(); ++i)
+        for (auto &segment: checkpoints[i].segments)
+            changed.push_back(segment.first);
+    std::sort(changed.begin(), changed.end());
+    changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+    for (auto index: changed) {
+        const std::vector<uint8_t> *version = nullptr;
+        for (auto i = idx + 1; i-- > 0 && !version;) {
+            auto it = checkpoints[i].segments.find(index);
+            if (it != checkpoints[i].segments.end())
+                version = &it->second;
+        }
+        auto &segment = memory.getSegment(index);
+        if (version)
+            segment.data = *version;
+        else
+            std::fill(segment.data.begin(), segment.data.end(), 0);
+        // still dirty relative to the latest checkpoint
+        memory.markDirty(index, segment);
+    }
+
+    auto &checkpoint = checkpoints[idx];
+    program.gpr_registers = checkpoint.gpr;
+    program.csr_registers = checkpoint.csr;
+    program.psw.val = checkpoint.psw;
+    program.instrCounter = checkpoint.retired;
+    program.incrementPC = true;
+    program.isEnd = false;
+    program.removeBreakpoints();
+    program.loadInstr();
+    if (program.eventLog)
+        program.eventLog->seek(checkpoint.retired);
+}
+
+void TimeTravel::run(Program &program, uint64_t retired) {
+    while (program.instrCounter < retired && !program.isEnd)
+        program.step();
+}
+
+void TimeTravel::goTo(Program &program, uint64_t retired) {
+    Muted muted(program, nullptr);
+    restore(program, nearest(retired));
+    run(program, retired);
+}
+
+bool TimeTravel::reverseStep(Program &program) {
+    if (program.instrCounter == 0 || checkpoints.empty() || program.instrCounter - 1 < checkpoints[0].retired)
+        return false;
+    goTo(program, program.instrCounter - 1);
+    return true;
+}
+
+bool TimeTravel::reverseToLastWrite(Program &program, const std::vector<std::pair<uint32_t, uint32_t>> &ranges) {
+    // search the intervals between checkpoints backwards, the first hit is the last write
+    auto now = program.instrCounter;
+    if (checkpoints.empty() || now < checkpoints[0].retired)
+        return false;
+    watchRanges = ranges;
+    for (auto idx = nearest(now) + 1; idx-- > 0;) {
+        auto end = idx + 1 < checkpoints.size() ? std::min(checkpoints[idx + 1].retired, now) : now;
+        lastWrite = 0;
+        {
+            Muted muted(program, this);
+            restore(program, idx);
+            run(program, end);
+        }
+        if (lastWrite) {
+            goTo(program, lastWrite - 1);
+            return true;
+        }
+    }
+    goTo(program, now);
+    return false;
+}
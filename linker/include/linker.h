@@ -47,6 +47,8 @@ public:
     std::set<SortedMapSection> resultSectionMapAddr; // in placeSection()
     std::unordered_map<SectionLink *, uintptr_t> sectionAddr; // in placeSection()
 
+    std::multiset<SortedMapSection> symbolMapAddr; // in mapSymbols()
+
     ~Linker() = default;
 
     void operator=(Linker const &) = delete;
@@ -69,6 +71,8 @@ public:
 
     void placeSection();
 
+    void mapSymbols();
+
     void link();
 
     void writeRelocatable() const;
@@ -77,8 +81,10 @@ public:
 
     void writeHex() const;
 
+    void writeMap() const;
+
     // must be -hex or -relocatable
-    // if -relocatable ignore all -place arguments
+    // if -relocatable ignore all -place arguments, the output is an object file that links again
     // -hex -place=data@0x4000F000 -place=text@0x40000000 -o program.hex main.o handler.o isr_terminal.o isr_timer.o
     // -relocatable -o mem_content.hex test1.o test2.o
 };
@@ -134,7 +134,7 @@ void Linker::testSectionSpace() {
         auto list = mapSameSections[it->name];
         uint32_t size = 0;
         for (auto &section: list)
-            size += section->data.size();
+            size += section->size();
         if (it->addr + size > next->addr)
             throw std::runtime_error("Section " + it->name + " overlaps with " + next->name);
     }
@@ -164,7 +164,7 @@ void Linker::placeSection() {
         // write to all sections with the same name
         for (auto sect: list) {
             sectionAddr[sect] = addr;
-            addr += sect->data.size();
+            addr += sect->size();
         }
         lastFreeAddr = lastFreeAddr > addr ? lastFreeAddr : addr;
         // remove from sectionNames
@@ -181,57 +181,82 @@ void Linker::placeSection() {
         resultSectionMapAddr.insert({sectionName, addr});
         for (auto sect: list) {
             sectionAddr[sect] = addr;
-            addr += sect->data.size();
+            addr += sect->size();
         }
     }
 }
 
+void Linker::mapSymbols() {
+    for (auto &file: inputFiles)
+        for (auto &symbol: file.symbols) {
+            if (!symbol.flags.defined || symbol.flags.symbolType != LABEL)
+                continue;
+            auto *section = &file.sections[symbol.sectionIndex];
+            symbolMapAddr.insert({symbol.name, sectionAddr[section] + symbol.offset});
+        }
+}
+
 void Linker::writeRelocatable() const {
     std::ofstream output(outputFile, std::ios::binary);
     if (!output)
         throw std::runtime_error("Failed to open file: " + outputFile);
 
-    // Write all sections to the output file
-    for (const auto &section: sections) {
-        // Write section name
-        uint32_t name_size = section->name.size();
-        output.write(reinterpret_cast<const char *>(&name_size), sizeof(uint32_t));
-        output.write(section->name.c_str(), name_size);
-
-        // Write section data size
-        uint64_t data_size = section->data.size();
-        output.write(reinterpret_cast<const char *>(&data_size), sizeof(uint64_t));
-
-        // Write section data
-        output.write(reinterpret_cast<const char *>(section->data.data()), data_size);
+    // the same layout the assembler writes, so the output links again: every input section is kept
+    // and the symbol and section indexes of each file are shifted past the files before it
+    std::vector<uint32_t> symbolBase, sectionBase;
+    uint32_t numSymbols = 0, numSections = 0, numRelocations = 0;
+    for (const auto &file: inputFiles) {
+        symbolBase.push_back(numSymbols);
+        sectionBase.push_back(numSections);
+        numSymbols += file.symbols.size();
+        numSections += file.sections.size();
+        numRelocations += file.relocations.size();
     }
 
-    // Write all symbols to the output file
-    for (const auto &file: inputFiles) {
-        for (const auto &symbol: file.symbols) {
-            // Write symbol name
+    // Write magic and version
+    output.write(reinterpret_cast<const char *>(&OBJECT_MAGIC), sizeof(OBJECT_MAGIC));
+    output.write(reinterpret_cast<const char *>(&OBJECT_VERSION), sizeof(OBJECT_VERSION));
+
+    // Write all symbols: name_size, name, offset, sectionIndex, flags
+    output.write(reinterpret_cast<const char *>(&numSymbols), sizeof(numSymbols));
+    for (size_t i = 0; i < inputFiles.size(); ++i)
+        for (const auto &symbol: inputFiles[i].symbols) {
             uint32_t name_size = symbol.name.size();
-            output.write(reinterpret_cast<const char *>(&name_size), sizeof(uint32_t));
+            output.write(reinterpret_cast<const char *>(&name_size), sizeof(name_size));
             output.write(symbol.name.c_str(), name_size);
+            output.write(reinterpret_cast<const char *>(&symbol.offset), sizeof(symbol.offset));
+            // undefined symbols and equ values have no section
+            auto sectionIndex = symbol.sectionIndex;
+            if (symbol.flags.defined && symbol.flags.symbolType != EQU)
+                sectionIndex += sectionBase[i];
+            output.write(reinterpret_cast<const char *>(&sectionIndex), sizeof(sectionIndex));
+            output.write(reinterpret_cast<const char *>(&symbol.flags), sizeof(symbol.flags));
+        }
 
-            // Write symbol offset
-            output.write(reinterpret_cast<const char *>(&symbol.offset), sizeof(uint64_t));
-
-            // Write symbol section index
-            output.write(reinterpret_cast<const char *>(&symbol.sectionIndex), sizeof(uint64_t));
-
-            // Write symbol flags
-            output.write(reinterpret_cast<const char *>(&symbol.flags), sizeof(uint8_t));
+    // Write all sections: name_size, name, data_size, data, zero_fill, num_code, code ranges
+    output.write(reinterpret_cast<const char *>(&numSections), sizeof(numSections));
+    for (const auto &file: inputFiles)
+        for (const auto &section: file.sections) {
+            uint32_t name_size = section.name.size();
+            output.write(reinterpret_cast<const char *>(&name_size), sizeof(name_size));
+            output.write(section.name.c_str(), name_size);
+            uint32_t data_size = section.data.size();
+            output.write(reinterpret_cast<const char *>(&data_size), sizeof(data_size));
+            output.write(reinterpret_cast<const char *>(section.data.data()), data_size);
+            output.write(reinterpret_cast<const char *>(&section.zeroFill), sizeof(section.zeroFill));
+            uint32_t num_code = section.code.size();
+            output.write(reinterpret_cast<const char *>(&num_code), sizeof(num_code));
+            output.write(reinterpret_cast<const char *>(section.code.data()), num_code * sizeof(section.code[0]));
         }
-    }
 
-    // Write all relocations to the output file
-    for (const auto &file: inputFiles) {
-        for (const auto &relocation: file.relocations) {
-            // Write relocation data
+    // Write all relocations, the words they patched are patched again by the next link
+    output.write(reinterpret_cast<const char *>(&numRelocations), sizeof(numRelocations));
+    for (size_t i = 0; i < inputFiles.size(); ++i)
+        for (auto relocation: inputFiles[i].relocations) {
+            relocation.symbolIndex += symbolBase[i];
+            relocation.sectionIndex += sectionBase[i];
             output.write(reinterpret_cast<const char *>(&relocation), sizeof(RelocationLink));
         }
-    }
 
     output.close();
 }
@@ -247,19 +272,21 @@ void Linker::link() {
             // write to this section
             auto &destSect = file.sections[rel.sectionIndex];
 
+            // local labels are only known in their own file, the others come from the global map
             auto &symbol = file.symbols[rel.symbolIndex];
-            auto ptrValue = std::make_unique<uint32_t>();
-            symbol = *globSymMapSymbol[file.symbols[rel.symbolIndex].name];
-            if (symbol.flags.symbolType == EQU)
-                *ptrValue.get() = symbol.offset;
+            uint32_t value;
+            if (symbol.flags.defined)
+                value = symbol.flags.symbolType == EQU ? symbol.offset
+                                                       : sectionAddr[&file.sections[symbol.sectionIndex]] + symbol.offset;
             else {
-                auto srcAddr = sectionAddr[globSymMapSection[file.symbols[rel.symbolIndex].name]];
-                *ptrValue.get() = srcAddr + symbol.offset;
+                auto &global = *globSymMapSymbol[symbol.name];
+                value = global.flags.symbolType == EQU ? global.offset
+                                                       : sectionAddr[globSymMapSection[symbol.name]] + global.offset;
             }
             switch (rel.type) {
-                case R_32_IMMEDIATE:
-                case R_32_IN_DIR:
-                    destSect.fixWord(ptrValue.get(), rel.offset);
+                case R_32_IMMEDIATE:    // pool word of a pc relative load
+                case R_32_IN_DIR:       // .word
+                    destSect.fixWord(&value, rel.offset);
                     break;
                 default:
                     throw std::runtime_error("Unknown relocation type");
@@ -274,8 +301,14 @@ void Linker::writeHex() const {
         throw std::runtime_error("Failed to open file: " + emulatorPath + outputFile);
 
     out << "# Sections: \n";
-    for (const auto &sect: resultSectionMapAddr)
-        out << "# \t 0x" << std::hex << sect.addr << ": " << sect.name << "\n";
+    // zero fills are not dumped, the emulator's memory reads as zero where nothing was loaded
+    for (const auto &sect: resultSectionMapAddr) {
+        out << "# \t 0x" << std::hex << sect.addr << ": " << sect.name;
+        auto zeroFill = mapMergedSections.at(sect.name)->zeroFill;
+        if (zeroFill)
+            out << " (0x" << zeroFill << " zero bytes at 0x" << sect.addr + mapMergedSections.at(sect.name)->data.size() << ")";
+        out << "\n";
+    }
 
     for (const auto &sect: resultSectionMapAddr) {
         auto name = sect.name;
@@ -285,6 +318,26 @@ void Linker::writeHex() const {
     out.close();
 }
 
+void Linker::writeMap() const {
+    // one record per line: "section <addr> <size> <name>", "code <addr> <size>" or "symbol <addr> <name>"
+    auto mapName = outputFile;
+    mapName.erase(mapName.end() - 4, mapName.end());
+    mapName.append(".map");
+    std::ofstream out(emulatorPath + mapName);
+    if (!out)
+        throw std::runtime_error("Failed to open file: " + emulatorPath + mapName);
+
+    for (const auto &sect: resultSectionMapAddr) {
+        auto *section = mapMergedSections.at(sect.name).get();
+        out << "section " << std::hex << sect.addr << " " << section->size() << " " << sect.name << "\n";
+        for (const auto &range: section->code)
+            out << "code " << std::hex << sect.addr + range.first << " " << range.second - range.first << "\n";
+    }
+    for (const auto &sym: symbolMapAddr)
+        out << "symbol " << std::hex << sym.addr << " " << sym.name << "\n";
+    out.close();
+}
+
 void Linker::writeExe() const {
     auto exeName = outputFile;
     exeName.erase(exeName.end() - 4, exeName.end());
@@ -292,7 +345,11 @@ void Linker::writeExe() const {
     if (!exeOutput)
         throw std::runtime_error("Failed to open file: " + emulatorPath + exeName);
 
+    // a zero fill is one more record of only address and size, flagged with ZERO_FILL_FLAG
     uint32_t numSections = resultSectionMapAddr.size();
+    for (const auto &sect: resultSectionMapAddr)
+        if (mapMergedSections.at(sect.name)->zeroFill)
+            ++numSections;
     // write number of section
     exeOutput.write(reinterpret_cast<const char *>(&numSections), sizeof(numSections));
 
@@ -310,6 +367,13 @@ void Linker::writeExe() const {
 
         // write sections
         exeOutput.write(reinterpret_cast<const char *>(section->data.data()), section->data.size());
+
+        if (section->zeroFill) {
+            address += sectionSize;
+            uint32_t zeroFill = section->zeroFill | ZERO_FILL_FLAG;
+            exeOutput.write(reinterpret_cast<const char *>(&address), sizeof(address));
+            exeOutput.write(reinterpret_cast<const char *>(&zeroFill), sizeof(zeroFill));
+        }
     }
     exeOutput.close();
 }
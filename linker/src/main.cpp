@@ -8,6 +8,7 @@ int main(int argc, char *argv[]) {
     linker.loadObjects();
     linker.resolveSymbols();
     linker.placeSection();
+    linker.mapSymbols();
     linker.link();
 
     linker.mergeSections();
@@ -18,8 +19,10 @@ int main(int argc, char *argv[]) {
 
     if (linker.options.relocatable)
         linker.writeRelocatable();
-    else
+    else {
         linker.writeExe();
+        linker.writeMap();
+    }
 
 //    auto programFile =
 //            std::make_unique<ProgramFile>();
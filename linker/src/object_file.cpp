@@ -12,6 +12,16 @@ void ObjectFile::loadFromFile(const std::string &inputFile) {
         return;
     }
 
+    // read magic, version; objects from an older assembler have neither and would be misparsed
+    uint32_t magic = 0, version = 0;
+    file.read((char *) &magic, sizeof(magic));
+    file.read((char *) &version, sizeof(version));
+    if (!file || magic != OBJECT_MAGIC)
+        throw std::runtime_error("Not an object file: " + inputFile + ", reassemble it");
+    if (version != OBJECT_VERSION)
+        throw std::runtime_error("Object file " + inputFile + " has version " + std::to_string(version)
+                                 + ", expected " + std::to_string(OBJECT_VERSION) + ", reassemble it");
+
     // read num_symbols
     uint32_t num_symbols;
     file.read((char *) &num_symbols, sizeof(uint32_t));
@@ -45,6 +55,11 @@ void ObjectFile::loadFromFile(const std::string &inputFile) {
         file.read((char *) &data_size, sizeof(data_size));
         sections[i].data.resize(data_size);
         file.read(reinterpret_cast<char *>(sections[i].data.data()), data_size);
+        file.read((char *) &sections[i].zeroFill, sizeof(sections[i].zeroFill));
+        uint32_t num_code;
+        file.read((char *) &num_code, sizeof(num_code));
+        sections[i].code.resize(num_code);
+        file.read(reinterpret_cast<char *>(sections[i].code.data()), num_code * sizeof(sections[i].code[0]));
     }
 
     // read num_relocations
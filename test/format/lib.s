@@ -0,0 +1,12 @@
+# file: lib.s
+# a second file whose symbols and sections follow main.o's in a -relocatable output
+
+.global lib_word
+
+.section data
+.skip 4
+lib_word:
+.word 0x33333333
+.skip 8
+
+.end
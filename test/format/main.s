@@ -0,0 +1,35 @@
+# file: main.s
+# words around .skip gaps, text whose |ascii| column looks like hex bytes, a short last hex line
+
+.extern lib_word
+
+.global my_start
+
+.section code
+my_start:
+    ld lib_word, %r1
+    st %r1, copied
+    ld $lib_ref, %r2
+    ld [%r2], %r3
+    ld [%r3], %r4
+    st %r4, copied_ref
+    halt
+
+.section data
+first:
+.word 0x11111111
+.skip 8
+after_gap:
+.word 0x22222222
+text:
+.ascii "12 34 ab cd ef 56 78 9a"
+.skip 1
+copied:
+.word 0
+copied_ref:
+.word 0
+lib_ref:
+.word lib_word
+.skip 12
+
+.end
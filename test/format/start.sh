@@ -0,0 +1,29 @@
+ASSEMBLER=../../assembler/bin/main
+LINKER=../../linker/bin/main
+EMULATOR=../../emulator/bin/main
+# the assembler writes objects next to the linker, the linker writes images next to the emulator
+OBJECTS=../../linker/bin
+IMAGES=../../emulator/bin
+PLACE="-place=code@0x40000000 -place=data@0x40001000"
+
+${ASSEMBLER} -o format_main.o main.s || exit 1
+${ASSEMBLER} -o format_lib.o lib.s || exit 1
+${LINKER} -hex ${PLACE} -o format.hex ${OBJECTS}/format_main.o ${OBJECTS}/format_lib.o || exit 1
+# -relocatable writes an object into the current directory, linked again it has to give the same image
+${LINKER} -relocatable -o format_all.o ${OBJECTS}/format_main.o ${OBJECTS}/format_lib.o || exit 1
+${LINKER} -hex ${PLACE} -o format_relinked.hex format_all.o || exit 1
+cmp ${IMAGES}/format ${IMAGES}/format_relinked || exit 1
+
+# both the exe and the hex dump, with its |ascii| column and padded last line, are loaded and checked
+for IMAGE in format format.hex format_relinked format_relinked.hex; do
+  ${EMULATOR} -no-trace -dump=${IMAGES}/${IMAGE}.dump ${IMAGES}/${IMAGE} || exit 1
+  ${EMULATOR} -dump-check=${IMAGES}/${IMAGE}.dump -expect=expected.txt -symbols=${IMAGES}/format.map || exit 1
+done
+
+# an object without the magic and version, as the assembler wrote them before the zero fill, is rejected
+printf '\001\000\000\000' > old.o
+if (${LINKER} -hex -o old.hex old.o; exit $?) 2> /dev/null; then
+  echo "object without magic was linked"
+  exit 1
+fi
+echo "format ok"
@@ -0,0 +1,49 @@
+# file: bench_checksum.s
+# 1000 checksums of 4093 bytes of a counting pattern
+
+.extern rt_checksum, rt_print, rt_exit
+
+.global my_start
+
+.section code
+my_start:
+    ld $data, %r1
+    xor %r2, %r2
+    ld $0x01020304, %r3
+    ld $4, %r4
+    ld $1024, %r5
+    ld $1, %r6
+fill:
+    st %r2, [%r1]
+    add %r3, %r2
+    add %r4, %r1
+    sub %r6, %r5
+    bne %r5, %r0, fill
+
+    ld $1000, %r4
+    ld $1, %r5
+bench:
+    ld $data, %r1
+    ld $4093, %r2
+    call rt_checksum
+    sub %r5, %r4
+    bne %r4, %r0, bench
+
+    ld $0x7A917000, %r2
+    bne %r1, %r2, fail
+    ld $passed, %r1
+    ld $64, %r2
+    call rt_print
+    halt
+fail:
+    ld $1, %r1
+    call rt_exit
+
+.section bench_data
+data:
+.skip 4096
+passed:
+.ascii "checksum ok"
+.word 0x0A
+
+.end
@@ -0,0 +1,72 @@
+# file: bench_itoa.s
+# 1000 conversions of the longest integer, then zero and a positive number
+
+.extern rt_itoa, rt_print, rt_exit
+
+.global my_start
+
+.section code
+my_start:
+    ld $1000, %r4
+    ld $1, %r5
+bench:
+    ld $0x80000000, %r1
+    ld $digits, %r2
+    call rt_itoa
+    sub %r5, %r4
+    bne %r4, %r0, bench
+
+    ld $11, %r2
+    bne %r1, %r2, fail
+    ld digits, %r1
+    ld $0x3431322D, %r2     # "-214"
+    bne %r1, %r2, fail
+    ld digits_middle, %r1
+    ld $0x33383437, %r2     # "7483"
+    bne %r1, %r2, fail
+    ld digits_last, %r1
+    ld $0x00383436, %r2     # "648"
+    bne %r1, %r2, fail
+
+    ld $0, %r1
+    ld $digits, %r2
+    call rt_itoa
+    ld $1, %r2
+    bne %r1, %r2, fail
+    ld digits, %r1
+    ld $0x30, %r2
+    bne %r1, %r2, fail
+
+    ld $1234567, %r1
+    ld $digits, %r2
+    call rt_itoa
+    ld $7, %r2
+    bne %r1, %r2, fail
+    ld $digits, %r1
+    ld $12, %r2
+    call rt_print
+    ld $newline, %r1
+    ld $4, %r2
+    call rt_print
+    ld $passed, %r1
+    ld $64, %r2
+    call rt_print
+    halt
+fail:
+    ld $1, %r1
+    call rt_exit
+
+.section bench_data
+digits:
+.skip 4
+digits_middle:
+.skip 4
+digits_last:
+.skip 4
+newline:
+.word 0x0A
+passed:
+.ascii "itoa ok"
+.word 0x0A
+
+.end
@@ -0,0 +1,59 @@
+# file: bench_memcpy.s
+# 1000 copies of 4093 bytes, the bytes past the end of the destination are kept
+
+.extern rt_memcpy, rt_memset, rt_checksum, rt_print, rt_exit
+
+.global my_start
+
+.section code
+my_start:
+    ld $src, %r1
+    ld $0x5A, %r2
+    ld $4096, %r3
+    call rt_memset
+    ld $0x7F, %r1
+    st %r1, dst_guard
+    ld $1000, %r4
+    ld $1, %r5
+bench:
+    ld $dst, %r1
+    ld $src, %r2
+    ld $4093, %r3
+    call rt_memcpy
+    sub %r5, %r4
+    bne %r4, %r0, bench
+
+    ld $dst, %r1
+    ld $4093, %r2
+    call rt_checksum
+    xor %r6, %r6
+    add %r1, %r6
+    ld $src, %r1
+    ld $4093, %r2
+    call rt_checksum
+    bne %r1, %r6, fail
+    ld dst_last, %r1
+    ld $0x7F00005A, %r2
+    bne %r1, %r2, fail
+    ld $passed, %r1
+    ld $64, %r2
+    call rt_print
+    halt
+fail:
+    ld $1, %r1
+    call rt_exit
+
+.section bench_data
+src:
+.skip 4096
+dst:
+.skip 4092
+dst_last:
+.skip 3
+dst_guard:
+.skip 4
+passed:
+.ascii "memcpy ok"
+.word 0x0A
+
+.end
@@ -0,0 +1,51 @@
+# file: bench_memset.s
+# 1000 fills of 4093 bytes, the bytes past the end of the destination are kept
+
+.extern rt_memset, rt_print, rt_exit
+
+.global my_start
+
+.section code
+my_start:
+    ld $0x7F, %r1
+    st %r1, dst_guard
+    ld $1000, %r4
+    ld $1, %r5
+bench:
+    ld $dst, %r1
+    ld $0x1A5, %r2
+    ld $4093, %r3
+    call rt_memset
+    sub %r5, %r4
+    bne %r4, %r0, bench
+
+    ld $0xA5A5A5A5, %r2
+    ld dst, %r1
+    bne %r1, %r2, fail
+    ld dst_middle, %r1
+    bne %r1, %r2, fail
+    ld dst_last, %r1
+    ld $0x7F0000A5, %r2
+    bne %r1, %r2, fail
+    ld $passed, %r1
+    ld $64, %r2
+    call rt_print
+    halt
+fail:
+    ld $1, %r1
+    call rt_exit
+
+.section bench_data
+dst:
+.skip 2048
+dst_middle:
+.skip 2044
+dst_last:
+.skip 3
+dst_guard:
+.skip 4
+passed:
+.ascii "memset ok"
+.word 0x0A
+
+.end
@@ -0,0 +1,43 @@
+# file: bench_print.s
+# 1000 bounded prints of one byte out of a longer string
+
+.extern rt_print, rt_exit
+
+.global my_start
+
+.section code
+my_start:
+    ld $1000, %r4
+    ld $1, %r5
+bench:
+    ld $dot, %r1
+    ld $1, %r2
+    call rt_print
+    bne %r1, %r5, fail
+    sub %r5, %r4
+    bne %r4, %r0, bench
+
+    ld $newline, %r1
+    ld $4, %r2
+    call rt_print
+    ld $passed, %r1
+    ld $64, %r2
+    call rt_print
+    ld $9, %r2
+    bne %r1, %r2, fail
+    halt
+fail:
+    ld $1, %r1
+    call rt_exit
+
+.section bench_data
+dot:
+.ascii ".not printed"
+.word 0
+newline:
+.word 0x0A
+passed:
+.ascii "print ok"
+.word 0x0A
+
+.end
@@ -0,0 +1,48 @@
+# file: bench_strlen.s
+# 1000 lengths of a 4001 byte string, then a bounded length of the same string
+
+.extern rt_memset, rt_strlen, rt_strnlen, rt_print, rt_exit
+
+.global my_start
+
+.section code
+my_start:
+    ld $text, %r1
+    ld $0x61, %r2
+    ld $4001, %r3
+    call rt_memset
+    ld $1000, %r4
+    ld $1, %r5
+bench:
+    ld $text, %r1
+    call rt_strlen
+    sub %r5, %r4
+    bne %r4, %r0, bench
+
+    ld $4001, %r2
+    bne %r1, %r2, fail
+    ld $text, %r1
+    ld $101, %r2
+    call rt_strnlen
+    bne %r1, %r2, fail
+    ld $text, %r1
+    ld $5000, %r2
+    call rt_strnlen
+    ld $4001, %r2
+    bne %r1, %r2, fail
+    ld $passed, %r1
+    ld $64, %r2
+    call rt_print
+    halt
+fail:
+    ld $1, %r1
+    call rt_exit
+
+.section bench_data
+text:
+.skip 4096
+passed:
+.ascii "strlen ok"
+.word 0x0A
+
+.end
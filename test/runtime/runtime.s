@@ -0,0 +1,423 @@
+# file: runtime.s
+#
+# Runtime library: memcpy, memset, strlen, strnlen, integer to string, checksum, bounded print and exit.
+# Arguments are passed in %r1, %r2 and %r3, the result comes back in %r1, every other register is preserved.
+# Memory is only accessed by words, the ISA has no byte loads or stores: bulk loops move 16 bytes per
+# iteration and the last 1-3 bytes of a destination are merged with a masked read-modify-write.
+# Word reads may go up to 3 bytes past the end of a source, they never change anything there.
+
+.global rt_memcpy, rt_memset, rt_strlen, rt_strnlen, rt_itoa, rt_checksum, rt_print, rt_exit
+
+.section runtime
+# rt_memcpy(%r1 dst, %r2 src, %r3 length) -> dst, the ranges must not overlap
+rt_memcpy:
+    push %r2
+    push %r3
+    push %r4
+    push %r5
+    push %r6
+    push %r7
+    push %r8
+    push %r9
+    push %r10
+    xor %r4, %r4
+    add %r1, %r4
+    ld $0xFFFFFFF0, %r9
+    and %r3, %r9
+    add %r2, %r9            # r9 = end of the 16 byte blocks in src
+    ld $15, %r5
+    and %r5, %r3            # r3 = bytes after the blocks
+    ld $16, %r10
+    beq %r2, %r9, memcpy_words
+memcpy_block:
+    ld [%r2], %r5
+    ld [%r2 + 4], %r6
+    ld [%r2 + 8], %r7
+    ld [%r2 + 12], %r8
+    st %r5, [%r4]
+    st %r6, [%r4 + 4]
+    st %r7, [%r4 + 8]
+    st %r8, [%r4 + 12]
+    add %r10, %r2
+    add %r10, %r4
+    bne %r2, %r9, memcpy_block
+memcpy_words:
+    ld $4, %r10
+    ld $3, %r9
+memcpy_word:
+    bgt %r9, %r3, memcpy_tail
+    ld [%r2], %r5
+    st %r5, [%r4]
+    add %r10, %r2
+    add %r10, %r4
+    sub %r10, %r3
+    jmp memcpy_word
+memcpy_tail:
+    beq %r3, %r0, memcpy_done
+    shl %r9, %r3            # r3 = 8 * bytes left
+    ld $1, %r6
+    shl %r3, %r6
+    ld $1, %r7
+    sub %r7, %r6            # r6 = mask of the bytes left
+    ld [%r2], %r5
+    and %r6, %r5
+    not %r6
+    ld [%r4], %r7
+    and %r6, %r7
+    or %r5, %r7
+    st %r7, [%r4]
+memcpy_done:
+    pop %r10
+    pop %r9
+    pop %r8
+    pop %r7
+    pop %r6
+    pop %r5
+    pop %r4
+    pop %r3
+    pop %r2
+    ret
+
+# rt_memset(%r1 dst, %r2 byte, %r3 length) -> dst
+rt_memset:
+    push %r2
+    push %r3
+    push %r4
+    push %r5
+    push %r6
+    push %r7
+    push %r9
+    push %r10
+    xor %r4, %r4
+    add %r1, %r4
+    ld $0xFF, %r5
+    and %r5, %r2
+    ld $0x01010101, %r5
+    mul %r5, %r2            # r2 = the byte in every lane
+    ld $0xFFFFFFF0, %r9
+    and %r3, %r9
+    add %r4, %r9            # r9 = end of the 16 byte blocks in dst
+    ld $15, %r5
+    and %r5, %r3
+    ld $16, %r10
+    beq %r4, %r9, memset_words
+memset_block:
+    st %r2, [%r4]
+    st %r2, [%r4 + 4]
+    st %r2, [%r4 + 8]
+    st %r2, [%r4 + 12]
+    add %r10, %r4
+    bne %r4, %r9, memset_block
+memset_words:
+    ld $4, %r10
+    ld $3, %r9
+memset_word:
+    bgt %r9, %r3, memset_tail
+    st %r2, [%r4]
+    add %r10, %r4
+    sub %r10, %r3
+    jmp memset_word
+memset_tail:
+    beq %r3, %r0, memset_done
+    shl %r9, %r3
+    ld $1, %r6
+    shl %r3, %r6
+    ld $1, %r7
+    sub %r7, %r6
+    and %r6, %r2
+    not %r6
+    ld [%r4], %r7
+    and %r6, %r7
+    or %r2, %r7
+    st %r7, [%r4]
+memset_done:
+    pop %r10
+    pop %r9
+    pop %r7
+    pop %r6
+    pop %r5
+    pop %r4
+    pop %r3
+    pop %r2
+    ret
+
+# rt_strlen(%r1 string) -> length, two words per iteration, (w - 0x01010101) & ~w & 0x80808080 is not
+# zero exactly when a byte of w is
+rt_strlen:
+    push %r2
+    push %r3
+    push %r4
+    push %r5
+    push %r6
+    push %r7
+    push %r8
+    xor %r2, %r2
+    add %r1, %r2
+    ld $0x01010101, %r3
+    ld $0x80808080, %r4
+    ld $4, %r7
+    ld $8, %r8
+strlen_words:
+    ld [%r2], %r5
+    ld [%r2], %r6
+    sub %r3, %r6
+    not %r5
+    and %r5, %r6
+    and %r4, %r6
+    bne %r6, %r0, strlen_found
+    ld [%r2 + 4], %r5
+    ld [%r2 + 4], %r6
+    add %r8, %r2
+    sub %r3, %r6
+    not %r5
+    and %r5, %r6
+    and %r4, %r6
+    beq %r6, %r0, strlen_words
+    sub %r7, %r2            # the zero is in the second word
+strlen_found:
+    ld $0xFF, %r6
+    ld $1, %r7
+strlen_byte:
+    ld [%r2], %r5
+    and %r6, %r5
+    beq %r5, %r0, strlen_done
+    add %r7, %r2
+    jmp strlen_byte
+strlen_done:
+    sub %r1, %r2
+    xor %r1, %r1
+    add %r2, %r1
+    pop %r8
+    pop %r7
+    pop %r6
+    pop %r5
+    pop %r4
+    pop %r3
+    pop %r2
+    ret
+
+# rt_strnlen(%r1 string, %r2 max) -> length, at most max
+rt_strnlen:
+    push %r2
+    push %r3
+    push %r4
+    push %r5
+    push %r6
+    push %r7
+    push %r8
+    push %r9
+    xor %r9, %r9
+    add %r1, %r9            # r9 = start
+    add %r1, %r2            # r2 = limit
+    xor %r8, %r8
+    add %r2, %r8
+    ld $3, %r5
+    sub %r5, %r8            # r8 = last address a whole word may start below
+    ld $0x01010101, %r3
+    ld $0x80808080, %r4
+    ld $4, %r7
+    jmp strnlen_test
+strnlen_word:
+    ld [%r1], %r5
+    ld [%r1], %r6
+    sub %r3, %r6
+    not %r5
+    and %r5, %r6
+    and %r4, %r6
+    bne %r6, %r0, strnlen_bytes
+    add %r7, %r1
+strnlen_test:
+    bgt %r8, %r1, strnlen_word
+strnlen_bytes:
+    ld $0xFF, %r6
+    ld $1, %r7
+strnlen_byte:
+    beq %r1, %r2, strnlen_done
+    ld [%r1], %r5
+    and %r6, %r5
+    beq %r5, %r0, strnlen_done
+    add %r7, %r1
+    jmp strnlen_byte
+strnlen_done:
+    sub %r9, %r1
+    pop %r9
+    pop %r8
+    pop %r7
+    pop %r6
+    pop %r5
+    pop %r4
+    pop %r3
+    pop %r2
+    ret
+
+# rt_itoa(%r1 value, %r2 buffer) -> length, writes the decimal digits and a terminating zero as whole
+# words, the buffer needs 12 bytes. Digits are taken from the negated value, -2147483648 has no positive.
+rt_itoa:
+    push %r2
+    push %r3
+    push %r4
+    push %r5
+    push %r6
+    push %r7
+    push %r8
+    push %r9
+    xor %r3, %r3            # r3 = characters pushed
+    ld $10, %r4
+    ld $0x30, %r5
+    ld $1, %r9
+    xor %r6, %r6
+    bgt %r0, %r1, itoa_negative
+    not %r1
+    add %r9, %r1
+    jmp itoa_digit
+itoa_negative:
+    ld $1, %r6
+itoa_digit:
+    xor %r7, %r7
+    add %r1, %r7
+    div %r4, %r7            # r7 = quotient, rounded toward zero
+    xor %r8, %r8
+    add %r7, %r8
+    mul %r4, %r8
+    sub %r1, %r8            # r8 = the digit
+    add %r5, %r8
+    push %r8
+    add %r9, %r3
+    xchg %r1, %r7
+    bne %r1, %r0, itoa_digit
+    beq %r6, %r0, itoa_pack_start
+    ld $0x2D, %r8
+    push %r8
+    add %r9, %r3
+itoa_pack_start:
+    xor %r1, %r1
+    add %r3, %r1
+    xor %r7, %r7            # r7 = word being packed
+    xor %r4, %r4            # r4 = bit position of the next character in it
+    ld $8, %r8
+    ld $32, %r5
+itoa_pack:
+    pop %r6
+    shl %r4, %r6
+    or %r6, %r7
+    add %r8, %r4
+    bne %r4, %r5, itoa_next
+    st %r7, [%r2]
+    ld $4, %r6
+    add %r6, %r2
+    xor %r7, %r7
+    xor %r4, %r4
+itoa_next:
+    sub %r9, %r3
+    bne %r3, %r0, itoa_pack
+    st %r7, [%r2]
+    pop %r9
+    pop %r8
+    pop %r7
+    pop %r6
+    pop %r5
+    pop %r4
+    pop %r3
+    pop %r2
+    ret
+
+# rt_checksum(%r1 buffer, %r2 length) -> checksum, Fletcher style over words: a sums the words, b sums
+# every a, the result is a ^ b. The last 1-3 bytes are taken as a word padded with zeros.
+rt_checksum:
+    push %r2
+    push %r3
+    push %r4
+    push %r5
+    push %r6
+    push %r7
+    push %r8
+    push %r9
+    push %r10
+    xor %r3, %r3
+    xor %r4, %r4
+    ld $0xFFFFFFF0, %r5
+    and %r2, %r5
+    add %r1, %r5            # r5 = end of the 16 byte blocks
+    ld $15, %r6
+    and %r6, %r2
+    ld $16, %r10
+    beq %r1, %r5, checksum_words
+checksum_block:
+    ld [%r1], %r6
+    ld [%r1 + 4], %r7
+    ld [%r1 + 8], %r8
+    ld [%r1 + 12], %r9
+    add %r6, %r3
+    add %r3, %r4
+    add %r7, %r3
+    add %r3, %r4
+    add %r8, %r3
+    add %r3, %r4
+    add %r9, %r3
+    add %r3, %r4
+    add %r10, %r1
+    bne %r1, %r5, checksum_block
+checksum_words:
+    ld $4, %r10
+    ld $3, %r5
+checksum_word:
+    bgt %r5, %r2, checksum_tail
+    ld [%r1], %r6
+    add %r6, %r3
+    add %r3, %r4
+    add %r10, %r1
+    sub %r10, %r2
+    jmp checksum_word
+checksum_tail:
+    beq %r2, %r0, checksum_done
+    ld $3, %r5
+    shl %r5, %r2
+    ld $1, %r7
+    shl %r2, %r7
+    ld $1, %r8
+    sub %r8, %r7
+    ld [%r1], %r6
+    and %r7, %r6
+    add %r6, %r3
+    add %r3, %r4
+checksum_done:
+    xor %r1, %r1
+    add %r3, %r1
+    xor %r4, %r1
+    pop %r10
+    pop %r9
+    pop %r8
+    pop %r7
+    pop %r6
+    pop %r5
+    pop %r4
+    pop %r3
+    pop %r2
+    ret
+
+# rt_print(%r1 string, %r2 max) -> bytes written, at most max bytes up to the terminating zero in one
+# semihosting write to stdout
+rt_print:
+    push %r2
+    push %r3
+    push %r1
+    call rt_strnlen
+    pop %r2
+    ld $1, %r3
+    st %r3, 0x6004          # handle, stdout
+    st %r2, 0x6008          # buffer
+    st %r1, 0x600C          # length
+    st %r3, 0x6000          # SEMI_WRITE
+    ld 0x6010, %r1
+    pop %r3
+    pop %r2
+    ret
+
+# rt_exit(%r1 status), the emulator exits with status under -semihost and halts otherwise
+rt_exit:
+    st %r1, 0x6004
+    ld $7, %r1
+    st %r1, 0x6000          # SEMI_EXIT
+    halt
+
+.end
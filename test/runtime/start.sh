@@ -0,0 +1,16 @@
+ASSEMBLER=../../assembler/bin/main
+LINKER=../../linker/bin/main
+EMULATOR=../../emulator/bin/main
+# the assembler writes objects next to the linker, the linker writes images next to the emulator
+OBJECTS=../../linker/bin
+IMAGES=../../emulator/bin
+
+${ASSEMBLER} -o runtime.o runtime.s
+for BENCH in memcpy memset strlen itoa checksum print; do
+  ${ASSEMBLER} -o bench_${BENCH}.o bench_${BENCH}.s
+  ${LINKER} -hex \
+    -place=code@0x40000000 \
+    -o bench_${BENCH}.hex \
+    ${OBJECTS}/bench_${BENCH}.o ${OBJECTS}/runtime.o
+  ${EMULATOR} -no-trace -semihost -stats ${IMAGES}/bench_${BENCH}.hex
+done